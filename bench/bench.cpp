@@ -0,0 +1,406 @@
+#include <locale.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include <QApplication>
+#include <QPainter>
+#include <QThread>
+#include <QTemporaryDir>
+#include <QDir>
+#include <QFile>
+#include <QElapsedTimer>
+
+#include "mpvwidget.h"
+#include "overlay.h"
+#include "overlaycache.h"
+#include "swrenderer.h"
+#include "discio.h"
+#include "memstats.h"
+#include "qthelper.hpp"
+
+// Microbenchmarks for the hot paths of the player, fed with synthetic input.
+// Every result is printed as one JSON object per line:
+//   {"name":"...","iterations":N,"ns_per_op":X,"mb_per_s":Y}
+// so that runs can be diffed or compared by script. Pass a substring as the
+// first argument to only run matching benchmarks.
+//
+// "--soak <disc> [iterations]" instead runs the resource soak test against a
+// real disc, see Bench::soak(); it exits non-zero if anything leaks.
+
+static const char *filter = NULL;
+static volatile uint64_t sink;
+
+static uint32_t lcg_state = 1;
+static uint32_t lcg() {
+    lcg_state = lcg_state * 1664525 + 1013904223;
+    return lcg_state >> 8;
+}
+
+template<typename F>
+static void run(const char *name, uint64_t bytes_per_op, F fn) {
+    using clock = std::chrono::steady_clock;
+    if (filter && !strstr(name, filter))
+        return;
+
+    // Calibrate so that each sample takes roughly 100 ms.
+    uint64_t iterations = 1;
+    while (true) {
+        auto start = clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+            fn();
+        double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        if (elapsed > 0.1 || iterations >= (1ULL << 30))
+            break;
+        iterations *= elapsed < 0.01 ? 10 : 2;
+    }
+
+    // Median of five samples.
+    std::vector<double> samples;
+    for (int n = 0; n < 5; n++) {
+        auto start = clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+            fn();
+        samples.push_back(std::chrono::duration<double, std::nano>(clock::now() - start).count() / iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+    double ns = samples[samples.size() / 2];
+    double mb_per_s = bytes_per_op ? bytes_per_op / ns * 1e9 / (1024 * 1024) : 0;
+
+    printf("{\"name\":\"%s\",\"iterations\":%" PRIu64 ",\"ns_per_op\":%.1f,\"mb_per_s\":%.1f}\n",
+        name, iterations, ns, mb_per_s);
+    fflush(stdout);
+}
+
+static std::vector<BD_PG_PALETTE_ENTRY> make_palette() {
+    std::vector<BD_PG_PALETTE_ENTRY> palette(256);
+    for (int i = 0; i < 256; i++) {
+        palette[i].Y = 16 + lcg() % 220;
+        palette[i].Cb = 16 + lcg() % 225;
+        palette[i].Cr = 16 + lcg() % 225;
+        palette[i].T = i == 0 ? 0 : lcg() % 256;
+    }
+    return palette;
+}
+
+// Lines inside [band_y, band_y + band_h) consist of short runs of 1..max_run
+// pixels, everything else is a single transparent run, like subtitles.
+// Every line ends with a zero-length run, as decoded by libbluray.
+static std::vector<BD_PG_RLE_ELEM> make_rle(int w, int h, int band_y, int band_h, int max_run) {
+    std::vector<BD_PG_RLE_ELEM> rle;
+    for (int y = 0; y < h; y++) {
+        if (y < band_y || y >= band_y + band_h) {
+            rle.push_back(BD_PG_RLE_ELEM({ .len = (uint16_t)w, .color = 0 }));
+        } else {
+            for (int x = 0; x < w;) {
+                uint16_t len = std::min<int>(1 + lcg() % max_run, w - x);
+                rle.push_back(BD_PG_RLE_ELEM({ .len = len, .color = (uint16_t)(lcg() % 256) }));
+                x += len;
+            }
+        }
+        rle.push_back(BD_PG_RLE_ELEM({ .len = 0, .color = 0 }));
+    }
+    return rle;
+}
+
+static bd_overlay_s make_overlay(uint16_t w, uint16_t h, const BD_PG_PALETTE_ENTRY *palette,
+                                 const BD_PG_RLE_ELEM *img) {
+    bd_overlay_s ov;
+    memset(&ov, 0, sizeof(ov));
+    ov.cmd = BD_OVERLAY_DRAW;
+    ov.w = w;
+    ov.h = h;
+    ov.palette = palette;
+    ov.img = img;
+    return ov;
+}
+
+class Bench {
+public:
+    static void overlay();
+    static void palette();
+    static void composite();
+    static void events(MpvWidget *widget);
+    static void qthelper();
+    static void io();
+    static int soak(MpvWidget *widget, const QString &disc, int iterations);
+};
+
+void Bench::overlay() {
+    std::vector<BD_PG_PALETTE_ENTRY> palette = make_palette();
+
+    // Typical IG button: fully populated, short runs.
+    std::vector<BD_PG_RLE_ELEM> menu = make_rle(400, 100, 0, 100, 16);
+    bd_overlay_s menu_ov = make_overlay(400, 100, palette.data(), menu.data());
+    run("overlay_decode/menu_400x100", 400 * 100, [&] {
+        sink += overlay_decode(&menu_ov).width();
+    });
+
+    // Full screen PG: two lines of text near the bottom.
+    std::vector<BD_PG_RLE_ELEM> pg = make_rle(1920, 1080, 900, 120, 8);
+    bd_overlay_s pg_ov = make_overlay(1920, 1080, palette.data(), pg.data());
+    run("overlay_decode/pg_1920x1080", 1920 * 1080, [&] {
+        sink += overlay_decode(&pg_ov).width();
+    });
+
+    // Capture a 16-button IG page and decode it at flush, as _overlay_cb does.
+    QThreadPool pool;
+    pool.setMaxThreadCount(std::min(QThread::idealThreadCount(), 4));
+    OverlayPage page;
+    run("overlay_page/flush_menu_16", 16 * 400 * 100, [&] {
+        page.clear();
+        for (int i = 0; i < 16; i++)
+            page.capture(&menu_ov);
+        sink += page.decode(&pool).size();
+    });
+}
+
+void Bench::palette() {
+    std::vector<BD_PG_PALETTE_ENTRY> palette = make_palette();
+    QRgb argb[256];
+
+    run("palette/bt601", sizeof(argb), [&] {
+        overlay_palette(palette.data(), false, argb);
+        sink += argb[255];
+    });
+    run("palette/bt709", sizeof(argb), [&] {
+        overlay_palette(palette.data(), true, argb);
+        sink += argb[255];
+    });
+}
+
+// Same scaling as paintGL(): disc-resolution objects onto a 720p widget.
+void Bench::composite() {
+    std::vector<BD_PG_PALETTE_ENTRY> palette = make_palette();
+    std::vector<BD_PG_RLE_ELEM> rle = make_rle(400, 100, 0, 100, 16);
+    bd_overlay_s ov = make_overlay(400, 100, palette.data(), rle.data());
+    QImage button = overlay_decode(&ov);
+
+    QImage target(1280, 720, QImage::Format_ARGB32_Premultiplied);
+    double rx = 1280.0 / 1920;
+    double ry = 720.0 / 1080;
+
+    for (int n : {1, 8, 32}) {
+        std::vector<graphic_t> graphics;
+        for (int i = 0; i < n; i++) {
+            graphics.push_back(graphic_t({
+                .x = (uint16_t)(i % 4 * 420), .y = (uint16_t)(i / 4 % 10 * 105),
+                .w = 400, .h = 100,
+                .g = button,
+                .charge = nullptr
+            }));
+        }
+
+        QByteArray name = "composite/objects_" + QByteArray::number(n);
+        run(name.constData(), (uint64_t)n * 400 * 100, [&] {
+            QPainter p(&target);
+            for (auto &graphic : graphics) {
+                QRectF rect(graphic.x * rx, graphic.y * ry, graphic.w * rx, graphic.h * ry);
+                p.drawImage(rect, graphic.g);
+            }
+        });
+
+        // The same page from OverlayCache, prescaled once: frames only blit.
+        OverlayCache cache([] {});
+        QRectF video(0, 0, 1280, 720);
+        while (!cache.lookup(graphics, QSizeF(1920, 1080), video, 1))
+            QThread::msleep(1);
+        name = "composite/cached_objects_" + QByteArray::number(n);
+        run(name.constData(), (uint64_t)n * 400 * 100, [&] {
+            QPainter p(&target);
+            OverlayCache::scaled_graphics_t scaled = cache.lookup(graphics, QSizeF(1920, 1080), video, 1);
+            for (const scaled_graphic_t &graphic : *scaled)
+                p.drawImage(graphic.pos, graphic.image);
+        });
+    }
+
+    // The software backend's blend of one prescaled button into the frame.
+    QImage scaled = button.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    QImage frame(1920, 1080, QImage::Format_RGB32);
+    frame.fill(Qt::darkBlue);
+    run("composite/sw_blend_400x100", 400 * 100 * 4, [&] {
+        for (int y = 0; y < scaled.height(); y++)
+            sw_blend((uint32_t *)frame.scanLine(y), (const uint32_t *)scaled.constScanLine(y), scaled.width());
+    });
+}
+
+// A burst of menu events, as seen after a button activation.
+static const BD_EVENT event_script[] = {
+    { BD_EVENT_UO_MASK_CHANGED, 0 },
+    { BD_EVENT_MENU, 1 },
+    { BD_EVENT_KEY_INTEREST_TABLE, 0x1ff },
+    { BD_EVENT_IG_STREAM, 1 },
+    { BD_EVENT_POPUP, 0 },
+    { BD_EVENT_PLAYMARK, 2 },
+    { BD_EVENT_STILL, 0 },
+    { BD_EVENT_SECONDARY_AUDIO, 0 },
+    { BD_EVENT_IDLE, 1 },
+    { BD_EVENT_NONE, 0 },
+};
+static unsigned event_index = 0;
+
+static int stub_event_source(BLURAY *bd, unsigned char *buf, int len, BD_EVENT *ev) {
+    (void)bd;
+    (void)buf;
+    (void)len;
+    *ev = event_script[event_index++ % (sizeof(event_script) / sizeof(event_script[0]))];
+    return 0;
+}
+
+void Bench::events(MpvWidget *widget) {
+    widget->read_event = stub_event_source;
+
+    // The dispatcher logs to the ring buffer; nothing is flushed here.
+    run("events/wait_idle_burst_9", 0, [&] {
+        sink += widget->_wait_idle();
+    });
+
+    widget->read_event = bd_read_ext;
+}
+
+void Bench::qthelper() {
+    QVariantList command = QVariantList() << "loadfile" << "/disc/BDMV/STREAM/00001.m2ts" << "replace";
+    run("qthelper/variant_to_node/command", 0, [&] {
+        mpv::qt::node_builder node(command);
+        sink += node.node()->format;
+    });
+
+    QVariantMap map;
+    for (int i = 0; i < 16; i++)
+        map.insert(QString("key%1").arg(i), i % 2 ? QVariant(i * 0.5) : QVariant(QString("value%1").arg(i)));
+    run("qthelper/variant_to_node/map_16", 0, [&] {
+        mpv::qt::node_builder node(map);
+        sink += node.node()->format;
+    });
+
+    mpv::qt::node_builder node(map);
+    run("qthelper/node_to_variant/map_16", 0, [&] {
+        sink += mpv::qt::node_to_variant(node.node()).toMap().size();
+    });
+}
+
+// libbluray reads streams in aligned units of 6144 bytes; wraps around at
+// the end so that every op is a read.
+static void read_units(BD_FILE_H *fp) {
+    static uint8_t unit[6144];
+    if (fp->read(fp, unit, sizeof(unit)) <= 0)
+        fp->seek(fp, 0, SEEK_SET);
+    sink += unit[0];
+}
+
+void Bench::io() {
+    QTemporaryDir dir;
+    QDir(dir.path()).mkpath("BDMV/STREAM");
+    QFile stream(dir.filePath("BDMV/STREAM/00000.m2ts"));
+    if (!stream.open(QIODevice::WriteOnly))
+        return;
+    QByteArray chunk(1 << 20, 0);
+    for (int i = 0; i < chunk.size(); i++)
+        chunk[i] = lcg();
+    for (int i = 0; i < 64; i++)
+        stream.write(chunk);
+    stream.close();
+
+    const struct { const char *name; DiscIO::backend_t backend; } backends[] = {
+        { "io/mmap_read_6144", DiscIO::BACKEND_MMAP },
+        { "io/pread_read_6144", DiscIO::BACKEND_PREAD },
+    };
+    for (const auto &backend : backends) {
+        DiscIO *io = DiscIO::open(dir.path(), backend.backend);
+        BD_FILE_H *fp = io ? io->open_file("BDMV/STREAM/00000.m2ts") : NULL;
+        if (fp == NULL) {
+            delete io;
+            continue;
+        }
+        run(backend.name, 6144, [&] {
+            read_units(fp);
+        });
+        fp->close(fp);
+        delete io;
+    }
+}
+
+static void pump_events(int ms) {
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < ms)
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+}
+
+static long rss_kb() {
+    long pages = 0;
+    long resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL)
+        return 0;
+    if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+    fclose(statm);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Opens a disc, navigates it and closes it again, over and over, alternating
+// between disc navigation and main feature mode. After every close nothing
+// may still be accounted to the disc; live bytes, peaks and RSS are printed
+// per iteration so that growth across iterations shows up as well. Returns
+// the number of iterations that leaked.
+int Bench::soak(MpvWidget *widget, const QString &disc, int iterations) {
+    widget->setProperty("vo", "null");
+    widget->setProperty("ao", "null");
+
+    int leaks = 0;
+    for (int i = 0; i < iterations; i++) {
+        widget->open_disc(disc, true, i % 2);
+        pump_events(500);
+        widget->seek_chapter(1);
+        pump_events(200);
+        widget->seek_title(60, false);
+        pump_events(200);
+        widget->open_menu();
+        pump_events(300);
+        widget->close_disc();
+        pump_events(50);
+
+        int64_t live = MemStats::total();
+        if (live != 0)
+            leaks++;
+
+        printf("{\"name\":\"soak\",\"iteration\":%d,\"leaked\":%" PRId64 ",\"rss_kb\":%ld",
+            i, live, rss_kb());
+        for (const mem_usage_t &usage : MemStats::snapshot())
+            printf(",\"%s_live\":%" PRId64 ",\"%s_peak\":%" PRId64,
+                usage.name, usage.live, usage.name, usage.peak);
+        printf("}\n");
+        fflush(stdout);
+    }
+    return leaks;
+}
+
+int main(int argc, char *argv[]) {
+    // No window is ever shown.
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication a(argc, argv);
+    setlocale(LC_NUMERIC, "C");
+
+    if (argc > 2 && !strcmp(argv[1], "--soak")) {
+        MpvWidget widget;
+        int iterations = argc > 3 ? atoi(argv[3]) : 20;
+        return Bench::soak(&widget, QString::fromLocal8Bit(argv[2]), iterations) ? 1 : 0;
+    }
+    if (argc > 1)
+        filter = argv[1];
+
+    Bench::overlay();
+    Bench::palette();
+    Bench::composite();
+    Bench::qthelper();
+    Bench::io();
+
+    MpvWidget widget;
+    Bench::events(&widget);
+    return 0;
+}
@@ -0,0 +1,11 @@
+CONFIG -= app_bundle
+CONFIG += console
+QT += openglwidgets multimedia concurrent
+
+QT_CONFIG -= no-pkg-config
+CONFIG += link_pkgconfig
+PKGCONFIG += mpv libbluray libavformat libavcodec libavutil
+
+TARGET = mpv_bd_bench
+include(../src/src.pri)
+SOURCES += bench.cpp
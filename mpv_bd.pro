@@ -1,13 +1,9 @@
 CONFIG -= app_bundle
-QT += openglwidgets
+QT += openglwidgets multimedia concurrent
 
 QT_CONFIG -= no-pkg-config
 CONFIG += link_pkgconfig
-PKGCONFIG += mpv libbluray
+PKGCONFIG += mpv libbluray libavformat libavcodec libavutil
 
-HEADERS = \
-    src/mpvwidget.h \
-    src/mainwindow.h
-SOURCES = src/main.cpp \
-    src/mpvwidget.cpp \
-    src/mainwindow.cpp
+include(src/src.pri)
+SOURCES += src/main.cpp
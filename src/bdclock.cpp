@@ -0,0 +1,44 @@
+#include "bdclock.h"
+
+#include <cmath>
+#include <algorithm>
+
+void BdClock::set_clip(const BLURAY_CLIP_INFO &clip_info) {
+    clip = clip_info;
+    time_pos = seconds(clip.in_time);
+}
+
+void BdClock::set_position(double position) {
+    time_pos = position;
+}
+
+void BdClock::reset() {
+    clip = BLURAY_CLIP_INFO();
+    time_pos = 0;
+}
+
+uint64_t BdClock::stream_pts_at(double mpv_time) const {
+    return ticks(mpv_time);
+}
+
+double BdClock::mpv_time_at(uint64_t stream_pts) const {
+    return seconds(stream_pts);
+}
+
+uint64_t BdClock::title_time_at(uint64_t stream_pts) const {
+    return stream_to_title(clip, stream_pts);
+}
+
+uint64_t BdClock::title_to_stream(const BLURAY_CLIP_INFO &clip, uint64_t title_time) {
+    uint64_t offset = title_time > clip.start_time ? title_time - clip.start_time : 0;
+    return clip.in_time + std::min(offset, clip.out_time - clip.in_time);
+}
+
+uint64_t BdClock::stream_to_title(const BLURAY_CLIP_INFO &clip, uint64_t stream_pts) {
+    uint64_t offset = stream_pts > clip.in_time ? stream_pts - clip.in_time : 0;
+    return clip.start_time + std::min(offset, clip.out_time - clip.in_time);
+}
+
+uint64_t BdClock::ticks(double seconds) {
+    return llround(std::max(seconds, 0.0) * RATE);
+}
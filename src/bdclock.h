@@ -0,0 +1,51 @@
+#ifndef BDCLOCK_H
+#define BDCLOCK_H
+
+#include <cstdint>
+
+#include <libbluray/bluray.h>
+
+// The one place that converts between mpv's playback position and the
+// clocks libbluray works with. All three are kept exact, without rounding
+// to seconds:
+//  - mpv time:    time-pos. Clips are loaded without rebase-start-time, so
+//                 this is the stream pts in seconds.
+//  - stream pts:  90 kHz timestamps inside the m2ts, as used by clip
+//                 in/out times, overlays, bd_user_input(), bd_mouse_select()
+//                 and bd_menu_call().
+//  - title time:  90 kHz since the start of the playlist, as used by
+//                 chapter marks, clip start times and bd_seek_time().
+// libbluray already converts the 45 kHz times of MPLS files to 90 kHz, so
+// everything here is 90 kHz. All methods must be called from the GUI
+// thread.
+class BdClock {
+public:
+    static const uint64_t RATE = 90000;
+
+    // A clip is about to be loaded.
+    void set_clip(const BLURAY_CLIP_INFO &clip);
+    void set_position(double time_pos);
+    void reset();
+
+    // Current position.
+    double position() const { return time_pos; }
+    uint64_t stream_pts() const { return stream_pts_at(time_pos); }
+    uint64_t title_time() const { return title_time_at(stream_pts()); }
+
+    uint64_t stream_pts_at(double mpv_time) const;
+    double mpv_time_at(uint64_t stream_pts) const;
+    uint64_t title_time_at(uint64_t stream_pts) const;
+
+    // Within the given play item.
+    static uint64_t title_to_stream(const BLURAY_CLIP_INFO &clip, uint64_t title_time);
+    static uint64_t stream_to_title(const BLURAY_CLIP_INFO &clip, uint64_t stream_pts);
+
+    static double seconds(uint64_t ticks) { return ticks / (double)RATE; }
+    static uint64_t ticks(double seconds);
+
+private:
+    BLURAY_CLIP_INFO clip = {};
+    double time_pos = 0;
+};
+
+#endif // BDCLOCK_H
@@ -0,0 +1,47 @@
+#ifndef BDRESOURCE_H
+#define BDRESOURCE_H
+
+#include <memory>
+#include <cstdlib>
+
+#include <libbluray/bluray.h>
+#include <libbluray/clpi_data.h>
+
+// Owners for what libbluray hands out, so that no early return or reopen
+// path can leak a handle or a parsed structure.
+
+struct bd_close_deleter {
+    void operator()(BLURAY *bd) const { bd_close(bd); }
+};
+struct bd_title_info_deleter {
+    void operator()(BLURAY_TITLE_INFO *info) const { bd_free_title_info(info); }
+};
+struct bd_clpi_deleter {
+    void operator()(CLPI_CL *cl) const { bd_free_clpi(cl); }
+};
+// bd_read_file() buffers are plain malloc() allocations.
+struct bd_buffer_deleter {
+    void operator()(void *data) const { free(data); }
+};
+
+typedef std::unique_ptr<BLURAY, bd_close_deleter> bd_ptr;
+typedef std::unique_ptr<BLURAY_TITLE_INFO, bd_title_info_deleter> title_info_ptr;
+typedef std::unique_ptr<CLPI_CL, bd_clpi_deleter> clpi_ptr;
+typedef std::unique_ptr<void, bd_buffer_deleter> bd_buffer_ptr;
+
+// Heap bytes held by a title info, for accounting.
+inline size_t title_info_bytes(const BLURAY_TITLE_INFO *info) {
+    size_t bytes = sizeof(*info) +
+                   info->clip_count * sizeof(BLURAY_CLIP_INFO) +
+                   info->chapter_count * sizeof(BLURAY_TITLE_CHAPTER) +
+                   info->mark_count * sizeof(BLURAY_TITLE_MARK);
+    for (uint32_t i = 0; i < info->clip_count; i++) {
+        const BLURAY_CLIP_INFO &clip = info->clips[i];
+        bytes += (clip.video_stream_count + clip.audio_stream_count + clip.pg_stream_count +
+                  clip.ig_stream_count + clip.sec_audio_stream_count + clip.sec_video_stream_count) *
+                 sizeof(BLURAY_STREAM_INFO);
+    }
+    return bytes;
+}
+
+#endif // BDRESOURCE_H
@@ -0,0 +1,111 @@
+#include "cachecontroller.h"
+#include "log.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cinttypes>
+#include <algorithm>
+
+static const double MIN_READAHEAD_SECS = 5;
+static const double MAX_READAHEAD_SECS = 60;
+// Until the storage has been measured.
+static const double DEFAULT_READAHEAD_SECS = 10;
+// Seconds of buffer per unit of spare storage throughput: 2x realtime gets
+// 20 s, 5x gets the minimum.
+static const double READAHEAD_SCALE = 20;
+// Clip averages hide the peaks of complex scenes.
+static const double PEAK_FACTOR = 1.5;
+static const double BACK_SECS = 5;
+static const int64_t MIN_BYTES = 16LL << 20;
+static const int64_t MAX_BYTES = 1024LL << 20;
+static const int64_t MIN_BACK_BYTES = 8LL << 20;
+static const double MAX_BOOST = 4;
+static const int DECISION_INTERVAL_MS = 2000;
+// Smaller changes are not worth reconfiguring the demuxer for.
+static const double HYSTERESIS = 0.25;
+// Typical BD video rate (48 Mbit/s), for clips without a known rate.
+static const double FALLBACK_RATE = 6e6;
+
+CacheController::CacheController(apply_fn apply): apply(apply) {
+    reset();
+}
+
+void CacheController::set_clip(const std::string &name, double bytes_per_sec) {
+    clip = name;
+    current.clip_rate = bytes_per_sec > 0 ? bytes_per_sec : FALLBACK_RATE;
+    boost = 1;
+    underrun = false;
+    stalled = false;
+    decide(true);
+}
+
+void CacheController::update(const QVariantMap &state) {
+    // Only a cache that is still filling reads as fast as the storage can.
+    double rate = state.value("raw-input-rate").toDouble();
+    if (!state.value("idle").toBool() && rate > 0)
+        current.input_rate = current.input_rate > 0 ? current.input_rate * 0.8 + rate * 0.2 : rate;
+
+    bool now_underrun = state.value("underrun").toBool();
+    bool new_underrun = now_underrun && !underrun;
+    underrun = now_underrun;
+    if (new_underrun) {
+        current.underruns++;
+        boost = std::min(boost * 1.5, MAX_BOOST);
+    }
+    decide(new_underrun);
+}
+
+void CacheController::paused_for_cache(bool paused) {
+    bool new_stall = paused && !stalled;
+    stalled = paused;
+    if (new_stall) {
+        current.stalls++;
+        boost = std::min(boost * 1.5, MAX_BOOST);
+        decide(true);
+    }
+}
+
+void CacheController::reset() {
+    clip.clear();
+    current = cache_status_t();
+    boost = 1;
+    underrun = false;
+    stalled = false;
+    since_decision.invalidate();
+}
+
+void CacheController::decide(bool force) {
+    if (clip.empty())
+        return;
+    if (!force && since_decision.isValid() && since_decision.elapsed() < DECISION_INTERVAL_MS)
+        return;
+    since_decision.start();
+
+    double readahead = DEFAULT_READAHEAD_SECS;
+    if (current.input_rate > 0) {
+        double headroom = current.input_rate / current.clip_rate;
+        readahead = headroom > 1 ? READAHEAD_SCALE / (headroom - 1) : MAX_READAHEAD_SECS;
+    }
+    readahead = std::min(std::clamp(readahead, MIN_READAHEAD_SECS, MAX_READAHEAD_SECS) * boost,
+                         MAX_READAHEAD_SECS);
+
+    int64_t max_bytes = std::clamp<int64_t>(current.clip_rate * PEAK_FACTOR * readahead, MIN_BYTES, MAX_BYTES);
+    int64_t max_back_bytes = std::clamp<int64_t>(current.clip_rate * BACK_SECS, MIN_BACK_BYTES, MAX_BYTES / 4);
+
+    bool changed = current.decisions == 0 ||
+                   std::abs(max_bytes - current.max_bytes) > current.max_bytes * HYSTERESIS;
+    if (!force && !changed)
+        return;
+
+    current.readahead_secs = readahead;
+    current.max_bytes = max_bytes;
+    current.max_back_bytes = max_back_bytes;
+    current.decisions++;
+    apply(max_bytes, max_back_bytes, readahead);
+
+    Log::write(LOG_LEVEL_INFO, "cache",
+        "%s: %.1f Mbit/s, storage %.1f MB/s, readahead %.0f s, max %" PRId64 " MiB, back %" PRId64 " MiB "
+        "(%" PRIu64 " underruns, %" PRIu64 " stalls)",
+        clip.c_str(), current.clip_rate * 8 / 1e6, current.input_rate / 1e6, readahead,
+        max_bytes >> 20, max_back_bytes >> 20, current.underruns, current.stalls);
+}
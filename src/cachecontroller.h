@@ -0,0 +1,63 @@
+#ifndef CACHECONTROLLER_H
+#define CACHECONTROLLER_H
+
+#include <string>
+#include <cstdint>
+#include <functional>
+
+#include <QVariantMap>
+#include <QElapsedTimer>
+
+typedef struct {
+    // Average rate of the clip being played, bytes/s.
+    double clip_rate;
+    // Smoothed rate at which the demuxer fills its cache, bytes/s; 0 until
+    // measured.
+    double input_rate;
+    // Current decision.
+    double readahead_secs;
+    int64_t max_bytes;
+    int64_t max_back_bytes;
+    // Times the demuxer ran dry, and times playback paused to refill.
+    uint64_t underruns;
+    uint64_t stalls;
+    // Decisions applied since the last reset.
+    uint64_t decisions;
+} cache_status_t;
+
+// Sizes mpv's demuxer cache for each clip from the clip's bitrate and the
+// throughput measured while filling the cache. Storage that is many times
+// faster than the stream gets a few seconds of readahead; storage barely
+// keeping up gets up to a minute, and every underrun or cache stall grows
+// it further for the rest of the clip. The byte limit follows the
+// readahead, so memory stays proportional to what the clip needs. All
+// methods must be called from the GUI thread.
+class CacheController {
+public:
+    typedef std::function<void(int64_t max_bytes, int64_t max_back_bytes, double readahead_secs)> apply_fn;
+
+    explicit CacheController(apply_fn apply);
+
+    // A new clip is about to be loaded; bytes_per_sec is 0 if unknown.
+    void set_clip(const std::string &name, double bytes_per_sec);
+    // Value of mpv's demuxer-cache-state.
+    void update(const QVariantMap &state);
+    void paused_for_cache(bool paused);
+    void reset();
+
+    const cache_status_t &status() const { return current; }
+
+private:
+    void decide(bool force);
+
+    apply_fn apply;
+    std::string clip;
+    cache_status_t current;
+    // Readahead multiplier after underruns in this clip.
+    double boost = 1;
+    bool underrun = false;
+    bool stalled = false;
+    QElapsedTimer since_decision;
+};
+
+#endif // CACHECONTROLLER_H
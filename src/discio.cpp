@@ -0,0 +1,931 @@
+#include "discio.h"
+#include "log.h"
+
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <algorithm>
+#include <strings.h>
+
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+
+#include <mpv/stream_cb.h>
+
+// Network folders are read in windows of this size and alignment.
+static const int64_t WINDOW_SIZE = 1 << 20;
+static const int64_t WINDOW_ALIGN = 4096;
+// How far ahead the kernel is asked to prefetch sequential reads.
+static const int64_t READAHEAD = 4 * WINDOW_SIZE;
+
+static const uint32_t UDF_BLOCK = 2048;
+static const char *PROTOCOL = "bdio";
+
+struct io_counter_t {
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> syscalls{0};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+};
+
+typedef struct {
+    // Byte range of the image; sparse extents read as zeros.
+    uint64_t offset;
+    uint64_t length;
+    bool sparse;
+} udf_extent_t;
+
+typedef struct {
+    bool directory;
+    uint64_t size;
+    std::vector<udf_extent_t> extents;
+} udf_entry_t;
+
+typedef struct {
+    std::string name;
+    bool directory;
+    uint16_t ref;
+    uint32_t lbn;
+} udf_child_t;
+
+static uint16_t le16(const uint8_t *p) {
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t le32(const uint8_t *p) {
+    return (uint32_t)p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t le64(const uint8_t *p) {
+    return le32(p) | (uint64_t)le32(p + 4) << 32;
+}
+
+// Descriptor tag with the expected identifier and a valid checksum.
+static bool udf_tag(const uint8_t *p, uint16_t id) {
+    if (p == NULL || le16(p) != id)
+        return false;
+    uint8_t sum = 0;
+    for (int i = 0; i < 16; i++)
+        if (i != 4) sum += p[i];
+    return sum == p[4];
+}
+
+static void utf8_append(std::string &out, uint32_t c) {
+    if (c < 0x80) {
+        out += (char)c;
+    } else if (c < 0x800) {
+        out += (char)(0xc0 | c >> 6);
+        out += (char)(0x80 | (c & 0x3f));
+    } else {
+        out += (char)(0xe0 | c >> 12);
+        out += (char)(0x80 | (c >> 6 & 0x3f));
+        out += (char)(0x80 | (c & 0x3f));
+    }
+}
+
+// OSTA compressed unicode: 8 bit Latin-1 or 16 bit big endian.
+static std::string udf_name(const uint8_t *p, size_t len) {
+    std::string name;
+    if (len == 0)
+        return name;
+    if (p[0] == 8) {
+        for (size_t i = 1; i < len; i++)
+            utf8_append(name, p[i]);
+    } else if (p[0] == 16) {
+        for (size_t i = 1; i + 1 < len; i += 2)
+            utf8_append(name, p[i] << 8 | p[i + 1]);
+    }
+    return name;
+}
+
+// Read-only UDF 2.50 reader over a mapping of the whole image. BD-ROM keeps
+// file entries and directories in a metadata partition whose blocks are
+// themselves a file in the physical partition; stream data lives in the
+// physical partition and is usually a handful of large extents.
+class UdfImage {
+public:
+    ~UdfImage();
+    static std::shared_ptr<const UdfImage> open(const std::string &path);
+
+    bool lookup(const std::string &rel, udf_entry_t *entry) const;
+    bool children(const udf_entry_t &dir, std::vector<udf_child_t> *out) const;
+
+    const uint8_t *data = NULL;
+    uint64_t size = 0;
+
+private:
+    typedef struct {
+        bool metadata;
+        uint16_t number;
+        // Physical partition start, in blocks.
+        uint32_t start;
+        // Metadata partitions: extents of the metadata file.
+        std::vector<udf_extent_t> extents;
+    } udf_map_t;
+
+    bool parse();
+    bool map(uint16_t ref, uint32_t lbn, uint64_t length, std::vector<udf_extent_t> *out) const;
+    const uint8_t *block(uint16_t ref, uint32_t lbn) const;
+    bool read_entry(uint16_t ref, uint32_t lbn, udf_entry_t *entry) const;
+    bool read_ads(uint16_t ref, const uint8_t *ads, uint32_t length, int type,
+                  std::vector<udf_extent_t> *out, int depth) const;
+
+    std::vector<udf_map_t> maps;
+    udf_entry_t root;
+};
+
+UdfImage::~UdfImage() {
+    if (data)
+        munmap((void *)data, size);
+}
+
+std::shared_ptr<const UdfImage> UdfImage::open(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    std::shared_ptr<UdfImage> image = std::make_shared<UdfImage>();
+    image->data = (const uint8_t *)map;
+    image->size = st.st_size;
+    if (!image->parse())
+        return NULL;
+    return image;
+}
+
+bool UdfImage::parse() {
+    // Anchor volume descriptor pointer.
+    if (size < 257 * UDF_BLOCK)
+        return false;
+    const uint8_t *anchor = data + 256 * UDF_BLOCK;
+    if (!udf_tag(anchor, 2))
+        return false;
+    uint32_t vds_length = le32(anchor + 16);
+    uint32_t vds_start = le32(anchor + 20);
+
+    // Main volume descriptor sequence: partitions and the logical volume.
+    std::map<uint16_t, uint32_t> partitions;
+    const uint8_t *lvd = NULL;
+    for (uint32_t i = 0; i < vds_length / UDF_BLOCK; i++) {
+        uint64_t offset = ((uint64_t)vds_start + i) * UDF_BLOCK;
+        if (offset + UDF_BLOCK > size)
+            return false;
+        const uint8_t *desc = data + offset;
+        if (udf_tag(desc, 5))
+            partitions[le16(desc + 22)] = le32(desc + 188);
+        else if (udf_tag(desc, 6))
+            lvd = desc;
+        else if (udf_tag(desc, 8))
+            break;
+    }
+    if (lvd == NULL || le32(lvd + 212) != UDF_BLOCK)
+        return false;
+
+    uint32_t map_count = le32(lvd + 268);
+    uint32_t table_length = le32(lvd + 264);
+    if (440 + table_length > UDF_BLOCK)
+        return false;
+    const uint8_t *pm = lvd + 440;
+    std::vector<uint32_t> metadata_files;
+    for (uint32_t i = 0; i < map_count && pm + 2 <= lvd + 440 + table_length; i++) {
+        udf_map_t map = {};
+        if (pm[0] == 1) {
+            map.number = le16(pm + 4);
+        } else if (pm[0] == 2 && !memcmp(pm + 5, "*UDF Metadata Partition", 23)) {
+            map.metadata = true;
+            map.number = le16(pm + 38);
+            metadata_files.push_back(le32(pm + 40));
+            metadata_files.push_back(le32(pm + 44));
+        } else if (pm[0] == 2 && !memcmp(pm + 5, "*UDF Sparable Partition", 23)) {
+            // Sparing only matters on rewritable media, not in images.
+            map.number = le16(pm + 38);
+        } else {
+            Log::write(LOG_LEVEL_ERROR, "io", "UDF: unsupported partition map type %d", pm[0]);
+            return false;
+        }
+        auto found = partitions.find(map.number);
+        if (found == partitions.end())
+            return false;
+        map.start = found->second;
+        maps.push_back(map);
+        pm += pm[1];
+    }
+
+    // The metadata file (or its mirror) is located in the physical
+    // partition with the same number.
+    for (size_t i = 0, file = 0; i < maps.size(); i++) {
+        if (!maps[i].metadata)
+            continue;
+        uint16_t physical = maps.size();
+        for (size_t j = 0; j < maps.size(); j++)
+            if (!maps[j].metadata && maps[j].number == maps[i].number)
+                physical = j;
+
+        udf_entry_t metadata;
+        if (!read_entry(physical, metadata_files[file], &metadata) &&
+            !read_entry(physical, metadata_files[file + 1], &metadata))
+            return false;
+        maps[i].extents = metadata.extents;
+        file += 2;
+    }
+
+    // File set descriptor, then the root directory.
+    const uint8_t *fsd = block(le16(lvd + 256), le32(lvd + 252));
+    if (!udf_tag(fsd, 256))
+        return false;
+    return read_entry(le16(fsd + 408), le32(fsd + 404), &root) && root.directory;
+}
+
+// Appends the image ranges of a run of blocks, merging contiguous ones.
+bool UdfImage::map(uint16_t ref, uint32_t lbn, uint64_t length, std::vector<udf_extent_t> *out) const {
+    if (ref >= maps.size())
+        return false;
+    const udf_map_t &partition = maps[ref];
+
+    auto append = [&](uint64_t offset, uint64_t len) {
+        if (!out->empty() && !out->back().sparse && out->back().offset + out->back().length == offset)
+            out->back().length += len;
+        else
+            out->push_back(udf_extent_t({ .offset = offset, .length = len, .sparse = false }));
+    };
+
+    if (!partition.metadata) {
+        uint64_t offset = ((uint64_t)partition.start + lbn) * UDF_BLOCK;
+        if (offset + length > size)
+            return false;
+        append(offset, length);
+        return true;
+    }
+
+    // Metadata partition addresses are offsets into the metadata file.
+    uint64_t pos = (uint64_t)lbn * UDF_BLOCK;
+    uint64_t end = pos + length;
+    uint64_t file_pos = 0;
+    for (const udf_extent_t &extent : partition.extents) {
+        uint64_t from = std::max(pos, file_pos);
+        uint64_t to = std::min(end, file_pos + extent.length);
+        if (from < to) {
+            if (extent.sparse)
+                return false;
+            append(extent.offset + from - file_pos, to - from);
+            pos = to;
+        }
+        file_pos += extent.length;
+        if (pos >= end)
+            return true;
+    }
+    return false;
+}
+
+const uint8_t *UdfImage::block(uint16_t ref, uint32_t lbn) const {
+    std::vector<udf_extent_t> extents;
+    if (!map(ref, lbn, UDF_BLOCK, &extents) || extents.size() != 1)
+        return NULL;
+    return data + extents[0].offset;
+}
+
+bool UdfImage::read_entry(uint16_t ref, uint32_t lbn, udf_entry_t *entry) const {
+    const uint8_t *fe = block(ref, lbn);
+    uint32_t ea_length, ad_length, ad_start;
+    if (udf_tag(fe, 261)) {
+        ea_length = le32(fe + 168);
+        ad_length = le32(fe + 172);
+        ad_start = 176;
+    } else if (udf_tag(fe, 266)) {
+        ea_length = le32(fe + 208);
+        ad_length = le32(fe + 212);
+        ad_start = 216;
+    } else {
+        return false;
+    }
+    ad_start += ea_length;
+    if ((uint64_t)ad_start + ad_length > UDF_BLOCK)
+        return false;
+
+    entry->directory = fe[27] == 4;
+    entry->size = le64(fe + 56);
+    entry->extents.clear();
+
+    int type = le16(fe + 34) & 7;
+    if (type == 3) {
+        // Data embedded in the entry itself.
+        entry->extents.push_back(udf_extent_t({
+            .offset = (uint64_t)(fe - data) + ad_start, .length = ad_length, .sparse = false
+        }));
+        return true;
+    }
+    if (type != 0 && type != 1)
+        return false;
+    return read_ads(ref, fe + ad_start, ad_length, type, &entry->extents, 0);
+}
+
+// Short (type 0) or long (type 1) allocation descriptors.
+bool UdfImage::read_ads(uint16_t ref, const uint8_t *ads, uint32_t length, int type,
+                        std::vector<udf_extent_t> *out, int depth) const {
+    uint32_t ad_size = type == 0 ? 8 : 16;
+    for (uint32_t i = 0; i + ad_size <= length; i += ad_size) {
+        uint32_t extent_length = le32(ads + i) & 0x3fffffff;
+        uint32_t kind = le32(ads + i) >> 30;
+        uint32_t lbn = le32(ads + i + 4);
+        uint16_t part = type == 0 ? ref : le16(ads + i + 8);
+        if (extent_length == 0)
+            break;
+
+        if (kind == 3) {
+            // Continued in an allocation extent descriptor.
+            const uint8_t *aed = block(part, lbn);
+            if (depth > 16 || !udf_tag(aed, 258) || 24 + le32(aed + 20) > UDF_BLOCK)
+                return false;
+            return read_ads(part, aed + 24, le32(aed + 20), type, out, depth + 1);
+        }
+        if (kind != 0) {
+            out->push_back(udf_extent_t({ .offset = 0, .length = extent_length, .sparse = true }));
+            continue;
+        }
+        if (!map(part, lbn, extent_length, out))
+            return false;
+    }
+    return true;
+}
+
+bool UdfImage::children(const udf_entry_t &dir, std::vector<udf_child_t> *out) const {
+    std::vector<uint8_t> content;
+    for (const udf_extent_t &extent : dir.extents) {
+        uint64_t length = std::min<uint64_t>(extent.length, dir.size - content.size());
+        if (extent.sparse)
+            content.insert(content.end(), length, 0);
+        else
+            content.insert(content.end(), data + extent.offset, data + extent.offset + length);
+        if (content.size() >= dir.size)
+            break;
+    }
+
+    // File identifier descriptors.
+    size_t pos = 0;
+    while (pos + 38 <= content.size()) {
+        const uint8_t *fid = content.data() + pos;
+        if (le16(fid) != 257)
+            return false;
+        uint8_t flags = fid[18];
+        uint8_t name_length = fid[19];
+        uint16_t iu_length = le16(fid + 36);
+        if (pos + 38 + iu_length + name_length > content.size())
+            return false;
+
+        // Skip deleted entries and the parent.
+        if (!(flags & 0x0c)) {
+            out->push_back(udf_child_t({
+                .name = udf_name(fid + 38 + iu_length, name_length),
+                .directory = (flags & 0x02) != 0,
+                .ref = le16(fid + 28),
+                .lbn = le32(fid + 24)
+            }));
+        }
+        pos += (38 + iu_length + name_length + 3) & ~3;
+    }
+    return true;
+}
+
+bool UdfImage::lookup(const std::string &rel, udf_entry_t *entry) const {
+    *entry = root;
+    size_t pos = 0;
+    while (pos < rel.size()) {
+        size_t end = rel.find('/', pos);
+        if (end == std::string::npos)
+            end = rel.size();
+        std::string name = rel.substr(pos, end - pos);
+        pos = end + 1;
+        if (name.empty())
+            continue;
+
+        std::vector<udf_child_t> list;
+        if (!entry->directory || !children(*entry, &list))
+            return false;
+        auto child = std::find_if(list.begin(), list.end(), [&](const udf_child_t &c) {
+            return !strcasecmp(c.name.c_str(), name.c_str());
+        });
+        if (child == list.end() || !read_entry(child->ref, child->lbn, entry))
+            return false;
+    }
+    return true;
+}
+
+class DiscFile {
+public:
+    DiscFile(std::shared_ptr<io_counter_t> counter, int64_t size): counter(counter), size(size) {}
+    virtual ~DiscFile() {}
+    // Bytes copied to buf, 0 at the end, < 0 on error.
+    virtual int64_t read_at(int64_t at, uint8_t *buf, int64_t len) = 0;
+
+    void record(int64_t bytes, uint64_t ns) {
+        counter->requests++;
+        counter->bytes += bytes > 0 ? bytes : 0;
+        counter->total_ns += ns;
+        uint64_t max = counter->max_ns;
+        while (ns > max && !counter->max_ns.compare_exchange_weak(max, ns));
+    }
+
+    std::shared_ptr<io_counter_t> counter;
+    int64_t size;
+    int64_t pos = 0;
+};
+
+class MmapFile: public DiscFile {
+public:
+    MmapFile(const uint8_t *data, int64_t size, std::shared_ptr<io_counter_t> counter):
+        DiscFile(counter, size), data(data) {}
+    ~MmapFile() {
+        if (data) {
+            munmap((void *)data, size);
+            counter->syscalls++;
+        }
+    }
+
+    // Page faults are not counted; this is the point of mapping.
+    int64_t read_at(int64_t at, uint8_t *buf, int64_t len) Q_DECL_OVERRIDE {
+        len = std::min(len, size - at);
+        if (len <= 0)
+            return 0;
+        memcpy(buf, data + at, len);
+        return len;
+    }
+
+private:
+    const uint8_t *data;
+};
+
+class PreadFile: public DiscFile {
+public:
+    PreadFile(int fd, int64_t size, std::shared_ptr<io_counter_t> counter):
+        DiscFile(counter, size), fd(fd) {
+        if (posix_memalign((void **)&window, WINDOW_ALIGN, WINDOW_SIZE))
+            window = NULL;
+    }
+    ~PreadFile() {
+        close(fd);
+        counter->syscalls++;
+        free(window);
+    }
+
+    int64_t read_at(int64_t at, uint8_t *buf, int64_t len) Q_DECL_OVERRIDE {
+        len = std::min(len, size - at);
+        if (len <= 0)
+            return 0;
+
+        int64_t done = 0;
+        while (done < len) {
+            int64_t offset = at + done;
+            if (offset < window_start || offset >= window_start + window_length) {
+                // Large requests skip the window.
+                if (window == NULL || len - done >= WINDOW_SIZE) {
+                    int64_t n = pread_full(buf + done, len - done, offset);
+                    return n < 0 && !done ? n : done + std::max<int64_t>(n, 0);
+                }
+                int64_t start = offset & ~(WINDOW_ALIGN - 1);
+                bool sequential = start == window_start + window_length;
+                window_start = start;
+                window_length = std::max<int64_t>(pread_full(window, WINDOW_SIZE, start), 0);
+                if (offset >= window_start + window_length)
+                    return done ? done : -1;
+                if (sequential)
+                    read_ahead(window_start + window_length);
+            }
+            int64_t n = std::min(len - done, window_start + window_length - offset);
+            memcpy(buf + done, window + (offset - window_start), n);
+            done += n;
+        }
+        return done;
+    }
+
+private:
+    int64_t pread_full(uint8_t *buf, int64_t len, int64_t offset) {
+        int64_t done = 0;
+        while (done < len) {
+            ssize_t n = pread(fd, buf + done, len - done, offset + done);
+            counter->syscalls++;
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                return done ? done : -1;
+            if (n == 0)
+                break;
+            done += n;
+        }
+        return done;
+    }
+
+    // Keeps the kernel (and the NFS/SMB client) a few windows ahead, hinting
+    // in large steps rather than once per window.
+    void read_ahead(int64_t from) {
+        if (from + WINDOW_SIZE <= hinted || from >= size)
+            return;
+        int64_t start = std::max(from, hinted);
+        posix_fadvise(fd, start, from + READAHEAD - start, POSIX_FADV_WILLNEED);
+        counter->syscalls++;
+        hinted = from + READAHEAD;
+    }
+
+    int fd;
+    uint8_t *window = NULL;
+    int64_t window_start = 0;
+    int64_t window_length = 0;
+    int64_t hinted = 0;
+};
+
+class IsoFile: public DiscFile {
+public:
+    IsoFile(std::shared_ptr<const UdfImage> image, const udf_entry_t &entry, std::shared_ptr<io_counter_t> counter):
+        DiscFile(counter, entry.size), image(image), extents(entry.extents) {}
+
+    int64_t read_at(int64_t at, uint8_t *buf, int64_t len) Q_DECL_OVERRIDE {
+        len = std::min(len, size - at);
+        if (len <= 0)
+            return 0;
+
+        // Reads are mostly sequential; resume from the last extent.
+        if (at < current_start) {
+            current = 0;
+            current_start = 0;
+        }
+        int64_t done = 0;
+        while (done < len) {
+            int64_t offset = at + done;
+            while (current < extents.size() && offset >= current_start + (int64_t)extents[current].length) {
+                current_start += extents[current].length;
+                current++;
+            }
+            if (current == extents.size())
+                break;
+
+            const udf_extent_t &extent = extents[current];
+            int64_t n = std::min(len - done, current_start + (int64_t)extent.length - offset);
+            if (extent.sparse)
+                memset(buf + done, 0, n);
+            else
+                memcpy(buf + done, image->data + extent.offset + (offset - current_start), n);
+            done += n;
+        }
+        return done;
+    }
+
+private:
+    std::shared_ptr<const UdfImage> image;
+    std::vector<udf_extent_t> extents;
+    size_t current = 0;
+    int64_t current_start = 0;
+};
+
+static DiscFile *file_of(BD_FILE_H *fp) {
+    return (DiscFile *)fp->internal;
+}
+
+static void file_close(BD_FILE_H *fp) {
+    delete file_of(fp);
+    delete fp;
+}
+
+static int64_t file_seek(BD_FILE_H *fp, int64_t offset, int32_t origin) {
+    DiscFile *file = file_of(fp);
+    if (origin == SEEK_CUR)
+        offset += file->pos;
+    else if (origin == SEEK_END)
+        offset += file->size;
+    if (offset < 0)
+        return -1;
+    file->pos = offset;
+    return offset;
+}
+
+static int64_t file_tell(BD_FILE_H *fp) {
+    return file_of(fp)->pos;
+}
+
+static int file_eof(BD_FILE_H *fp) {
+    return file_of(fp)->pos >= file_of(fp)->size;
+}
+
+static int64_t file_read(BD_FILE_H *fp, uint8_t *buf, int64_t size) {
+    DiscFile *file = file_of(fp);
+    auto start = std::chrono::steady_clock::now();
+    int64_t n = file->read_at(file->pos, buf, size);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (n > 0)
+        file->pos += n;
+    file->record(n, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    return n;
+}
+
+static int64_t file_write(BD_FILE_H *fp, const uint8_t *buf, int64_t size) {
+    (void)fp;
+    (void)buf;
+    (void)size;
+    return -1;
+}
+
+typedef struct {
+    std::vector<std::string> names;
+    size_t next;
+} dir_list_t;
+
+static void dir_close(BD_DIR_H *dp) {
+    delete (dir_list_t *)dp->internal;
+    delete dp;
+}
+
+static int dir_read(BD_DIR_H *dp, BD_DIRENT *entry) {
+    dir_list_t *list = (dir_list_t *)dp->internal;
+    if (list->next >= list->names.size())
+        return 1;
+    snprintf(entry->d_name, sizeof(entry->d_name), "%s", list->names[list->next++].c_str());
+    return 0;
+}
+
+static BD_DIR_H *dir_open_cb(void *handle, const char *rel_path) {
+    return ((DiscIO *)handle)->open_dir(rel_path);
+}
+
+static BD_FILE_H *file_open_cb(void *handle, const char *rel_path) {
+    return ((DiscIO *)handle)->open_file(rel_path);
+}
+
+static std::string normalize(const char *rel_path) {
+    std::string rel = rel_path ? rel_path : "";
+    while (!rel.empty() && rel.front() == '/')
+        rel.erase(0, 1);
+    while (!rel.empty() && rel.back() == '/')
+        rel.pop_back();
+    return rel;
+}
+
+static DiscIO::backend_t folder_backend(const std::string &root) {
+    QByteArray env = qgetenv("MPV_BD_IO");
+    if (env == "mmap")
+        return DiscIO::BACKEND_MMAP;
+    if (env == "pread")
+        return DiscIO::BACKEND_PREAD;
+
+#ifdef __linux__
+    struct statfs fs;
+    if (statfs(root.c_str(), &fs) == 0) {
+        switch ((uint32_t)fs.f_type) {
+            case 0x6969:     // NFS
+            case 0x517b:     // SMB
+            case 0xff534d42: // CIFS
+            case 0xfe534d42: // SMB2
+            case 0x65735546: // FUSE (sshfs, rclone, ...)
+            case 0x00c36400: // Ceph
+                return DiscIO::BACKEND_PREAD;
+        }
+    }
+#endif
+    return DiscIO::BACKEND_MMAP;
+}
+
+DiscIO::DiscIO(const std::string &root, backend_t type): root(root), type(type) {}
+
+DiscIO::~DiscIO() {}
+
+DiscIO *DiscIO::open(const QString &path, backend_t backend) {
+    std::string root = path.toLocal8Bit().toStdString();
+    struct stat st;
+    if (stat(root.c_str(), &st) < 0)
+        return NULL;
+
+    if (S_ISREG(st.st_mode)) {
+        std::shared_ptr<const UdfImage> image = UdfImage::open(root);
+        if (image == NULL) {
+            Log::write(LOG_LEVEL_ERROR, "io", "%s: not a UDF image", root.c_str());
+            return NULL;
+        }
+        DiscIO *io = new DiscIO(root, BACKEND_ISO);
+        io->image = image;
+        return io;
+    }
+    if (!S_ISDIR(st.st_mode) || backend == BACKEND_ISO)
+        return NULL;
+
+    // The BDMV folder itself stands for its parent.
+    while (root.size() > 1 && root.back() == '/')
+        root.pop_back();
+    if (root.size() >= 4 && !strcasecmp(root.c_str() + root.size() - 4, "BDMV") &&
+        access((root + "/index.bdmv").c_str(), F_OK) == 0) {
+        size_t slash = root.find_last_of('/');
+        root = slash == std::string::npos ? "." : slash == 0 ? "/" : root.substr(0, slash);
+    }
+    return new DiscIO(root, backend == BACKEND_AUTO ? folder_backend(root) : backend);
+}
+
+BLURAY *DiscIO::open_bluray() {
+    BLURAY *bd = bd_init();
+    if (bd == NULL)
+        return NULL;
+    if (!bd_open_files(bd, this, dir_open_cb, file_open_cb)) {
+        bd_close(bd);
+        return NULL;
+    }
+    return bd;
+}
+
+std::shared_ptr<io_counter_t> DiscIO::counter(const std::string &rel) {
+    std::lock_guard<std::mutex> lock(counters_mutex);
+    std::shared_ptr<io_counter_t> &counter = counters[rel];
+    if (counter == NULL)
+        counter = std::make_shared<io_counter_t>();
+    return counter;
+}
+
+BD_FILE_H *DiscIO::open_file(const char *rel_path) {
+    std::string rel = normalize(rel_path);
+    DiscFile *file = NULL;
+
+    if (type == BACKEND_ISO) {
+        udf_entry_t entry;
+        if (!image->lookup(rel, &entry) || entry.directory)
+            return NULL;
+        file = new IsoFile(image, entry, counter(rel));
+    } else {
+        // Probing for optional files is common; only count files that exist.
+        int fd = ::open((root + "/" + rel).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return NULL;
+        struct stat st;
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+            close(fd);
+            return NULL;
+        }
+        std::shared_ptr<io_counter_t> stats = counter(rel);
+        stats->syscalls += 2;
+
+        if (type == BACKEND_MMAP && st.st_size > 0) {
+            void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            stats->syscalls++;
+            if (map != MAP_FAILED) {
+                // Streams are read front to back, everything else whole.
+                madvise(map, st.st_size, st.st_size > WINDOW_SIZE ? MADV_SEQUENTIAL : MADV_WILLNEED);
+                close(fd);
+                stats->syscalls += 2;
+                file = new MmapFile((const uint8_t *)map, st.st_size, stats);
+            }
+        }
+        if (file == NULL)
+            file = new PreadFile(fd, st.st_size, stats);
+    }
+
+    BD_FILE_H *fp = new BD_FILE_H();
+    fp->internal = file;
+    fp->close = file_close;
+    fp->seek = file_seek;
+    fp->tell = file_tell;
+    fp->eof = file_eof;
+    fp->read = file_read;
+    fp->write = file_write;
+    return fp;
+}
+
+BD_DIR_H *DiscIO::open_dir(const char *rel_path) {
+    std::string rel = normalize(rel_path);
+    dir_list_t *list = new dir_list_t();
+
+    if (type == BACKEND_ISO) {
+        udf_entry_t entry;
+        std::vector<udf_child_t> children;
+        if (!image->lookup(rel, &entry) || !entry.directory || !image->children(entry, &children)) {
+            delete list;
+            return NULL;
+        }
+        for (const udf_child_t &child : children)
+            list->names.push_back(child.name);
+    } else {
+        DIR *dir = opendir((root + "/" + rel).c_str());
+        if (dir == NULL) {
+            delete list;
+            return NULL;
+        }
+        while (struct dirent *entry = readdir(dir)) {
+            if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+                list->names.push_back(entry->d_name);
+        }
+        closedir(dir);
+    }
+
+    BD_DIR_H *dp = new BD_DIR_H();
+    dp->internal = list;
+    dp->close = dir_close;
+    dp->read = dir_read;
+    return dp;
+}
+
+QString DiscIO::stream_url(const QString &rel_path) const {
+    QString path = QString::fromLocal8Bit(root.c_str());
+    if (type == BACKEND_ISO)
+        return QString(PROTOCOL) + "://" + path + "|" + rel_path;
+    return path + "/" + rel_path;
+}
+
+std::vector<discio_stats_t> DiscIO::stats() const {
+    std::lock_guard<std::mutex> lock(counters_mutex);
+    std::vector<discio_stats_t> result;
+    for (const auto &[path, counter] : counters) {
+        result.push_back(discio_stats_t({
+            .path = path,
+            .bytes = counter->bytes,
+            .requests = counter->requests,
+            .syscalls = counter->syscalls,
+            .total_ns = counter->total_ns,
+            .max_ns = counter->max_ns
+        }));
+    }
+    return result;
+}
+
+void DiscIO::log_stats(const char *prefix) const {
+    static const char *names[] = { "auto", "mmap", "pread", "iso" };
+    for (const discio_stats_t &file : stats()) {
+        if (!file.requests)
+            continue;
+        Log::write(LOG_LEVEL_INFO, "io", "%s (%s) %s: %.2f MiB in %" PRIu64 " reads, %" PRIu64 " syscalls, "
+                   "%.1f us avg, %.1f us max",
+                   prefix, names[type], file.path.c_str(), file.bytes / (1024.0 * 1024), file.requests,
+                   file.syscalls, file.total_ns / 1e3 / file.requests, file.max_ns / 1e3);
+    }
+}
+
+// mpv side: bdio://<image>|<path inside the image>. Every stream opens its
+// own mapping, so it does not depend on the libbluray instance.
+typedef struct {
+    DiscIO *io;
+    BD_FILE_H *fp;
+} stream_t;
+
+static int64_t stream_read(void *cookie, char *buf, uint64_t nbytes) {
+    stream_t *stream = (stream_t *)cookie;
+    int64_t n = stream->fp->read(stream->fp, (uint8_t *)buf, nbytes);
+    return n < 0 ? -1 : n;
+}
+
+static int64_t stream_seek(void *cookie, int64_t offset) {
+    stream_t *stream = (stream_t *)cookie;
+    int64_t pos = stream->fp->seek(stream->fp, offset, SEEK_SET);
+    return pos < 0 ? (int64_t)MPV_ERROR_GENERIC : pos;
+}
+
+static int64_t stream_size(void *cookie) {
+    return file_of(((stream_t *)cookie)->fp)->size;
+}
+
+static void stream_close(void *cookie) {
+    stream_t *stream = (stream_t *)cookie;
+    stream->fp->close(stream->fp);
+    if (qEnvironmentVariableIsSet("MPV_BD_IO_STATS"))
+        stream->io->log_stats("mpv");
+    delete stream->io;
+    delete stream;
+}
+
+static int stream_open(void *user_data, char *uri, mpv_stream_cb_info *info) {
+    (void)user_data;
+    std::string url = uri;
+    size_t prefix = strlen(PROTOCOL) + 3;
+    size_t separator = url.rfind('|');
+    if (url.size() < prefix || separator == std::string::npos || separator < prefix)
+        return MPV_ERROR_LOADING_FAILED;
+
+    std::string image = url.substr(prefix, separator - prefix);
+    DiscIO *io = DiscIO::open(QString::fromLocal8Bit(image.c_str()), DiscIO::BACKEND_ISO);
+    if (io == NULL)
+        return MPV_ERROR_LOADING_FAILED;
+    BD_FILE_H *fp = io->open_file(url.c_str() + separator + 1);
+    if (fp == NULL) {
+        delete io;
+        return MPV_ERROR_LOADING_FAILED;
+    }
+
+    info->cookie = new stream_t({ .io = io, .fp = fp });
+    info->read_fn = stream_read;
+    info->seek_fn = stream_seek;
+    info->size_fn = stream_size;
+    info->close_fn = stream_close;
+    return 0;
+}
+
+bool DiscIO::add_protocol(mpv_handle *mpv) {
+    return mpv_stream_cb_add_ro(mpv, PROTOCOL, NULL, stream_open) >= 0;
+}
@@ -0,0 +1,77 @@
+#ifndef DISCIO_H
+#define DISCIO_H
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <libbluray/bluray.h>
+#include <libbluray/filesystem.h>
+#include <mpv/client.h>
+
+#include <QString>
+
+typedef struct {
+    std::string path;
+    uint64_t bytes;
+    // read() calls made by the caller (libbluray or mpv).
+    uint64_t requests;
+    // System calls issued to serve them, including open/close.
+    uint64_t syscalls;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} discio_stats_t;
+
+class UdfImage;
+struct io_counter_t;
+
+// Disc file access for libbluray (bd_open_files) and mpv (bdio:// streams).
+//  - MMAP:  local BDMV folders, every file is mapped once and read by memcpy.
+//  - PREAD: network folders, reads are served from 1 MiB aligned windows
+//           with read-ahead hints, so libbluray's 6 KiB reads do not each
+//           become a round trip.
+//  - ISO:   UDF 2.50 images read directly from a mapping of the image,
+//           without loop-mounting.
+// Counters are kept per file path and survive reopening the same file.
+class DiscIO {
+public:
+    enum backend_t { BACKEND_AUTO, BACKEND_MMAP, BACKEND_PREAD, BACKEND_ISO };
+
+    // AUTO picks ISO for image files, PREAD for folders on network
+    // filesystems and MMAP otherwise; MPV_BD_IO=mmap|pread overrides the
+    // choice for folders. Returns NULL if path is not usable.
+    static DiscIO *open(const QString &path, backend_t backend = BACKEND_AUTO);
+    ~DiscIO();
+
+    // bd_init() + bd_open_files() on this instance, which has to outlive
+    // the returned handle.
+    BLURAY *open_bluray();
+
+    // Paths are relative to the disc root, e.g. "BDMV/index.bdmv".
+    BD_FILE_H *open_file(const char *rel_path);
+    BD_DIR_H *open_dir(const char *rel_path);
+
+    // What mpv should load for a file on the disc.
+    QString stream_url(const QString &rel_path) const;
+    // Registers the bdio:// protocol used for files inside ISO images.
+    static bool add_protocol(mpv_handle *mpv);
+
+    backend_t backend() const { return type; }
+    std::vector<discio_stats_t> stats() const;
+    void log_stats(const char *prefix) const;
+
+private:
+    DiscIO(const std::string &root, backend_t type);
+    std::shared_ptr<io_counter_t> counter(const std::string &rel);
+
+    std::string root;
+    backend_t type;
+    std::shared_ptr<const UdfImage> image;
+    mutable std::mutex counters_mutex;
+    std::map<std::string, std::shared_ptr<io_counter_t>> counters;
+};
+
+#endif // DISCIO_H
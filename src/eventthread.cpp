@@ -0,0 +1,161 @@
+#include "eventthread.h"
+#include "mpvwidget.h"
+#include "log.h"
+#include "qthelper.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static queued_event_t copy_event(const mpv_event *event) {
+    queued_event_t queued({
+        .event_id = event->event_id,
+        .error = event->error,
+        .reply_userdata = event->reply_userdata,
+        .name = std::string(),
+        .format = MPV_FORMAT_NONE,
+        .value_double = 0,
+        .value_flag = 0,
+        .value_node = QVariant(),
+        .reason = MPV_END_FILE_REASON_EOF
+    });
+
+    if (event->event_id == MPV_EVENT_PROPERTY_CHANGE) {
+        const mpv_event_property *prop = (const mpv_event_property *)event->data;
+        queued.name = prop->name;
+        queued.format = prop->format;
+        if (prop->format == MPV_FORMAT_DOUBLE)
+            queued.value_double = *(double *)prop->data;
+        else if (prop->format == MPV_FORMAT_FLAG)
+            queued.value_flag = *(int *)prop->data;
+        else if (prop->format == MPV_FORMAT_NODE)
+            queued.value_node = mpv::qt::node_to_variant((mpv_node *)prop->data);
+        else
+            queued.format = MPV_FORMAT_NONE;
+    } else if (event->event_id == MPV_EVENT_END_FILE) {
+        queued.reason = ((const mpv_event_end_file *)event->data)->reason;
+    }
+    return queued;
+}
+
+EventThread::EventThread(MpvWidget *widget, mpv_handle *mpv): widget(widget), mpv(mpv) {}
+
+EventThread::~EventThread() {
+    stop();
+}
+
+void EventThread::stop() {
+    if (!isRunning()) return;
+    quit = true;
+    mpv_wakeup(mpv);
+    wait();
+}
+
+void EventThread::set_frame_interval(double seconds) {
+    frame_interval_ns = seconds * 1e9;
+}
+
+void EventThread::run() {
+    while (!quit) {
+        // Sleep until the next event, or until merged property changes are
+        // due for delivery.
+        double timeout = -1;
+        if (properties_pending) {
+            int64_t due = last_post_ns + frame_interval_ns - now_ns();
+            if (due <= 0) {
+                post();
+                continue;
+            }
+            timeout = due / 1e9;
+        }
+
+        // Drain everything that is queued in one go.
+        mpv_event *event = mpv_wait_event(mpv, timeout);
+        while (event->event_id != MPV_EVENT_NONE) {
+            if (event->event_id == MPV_EVENT_SHUTDOWN)
+                return;
+            queue(event);
+            event = mpv_wait_event(mpv, 0);
+        }
+    }
+}
+
+void EventThread::queue(mpv_event *event) {
+    received_count++;
+
+    if (event->event_id == MPV_EVENT_LOG_MESSAGE) {
+        mpv_event_log_message *msg = (mpv_event_log_message *)event->data;
+        char category[16];
+        snprintf(category, sizeof(category), "mpv/%s", msg->prefix);
+        Log::write((log_level_t)msg->log_level, category, "%s", msg->text);
+        return;
+    }
+
+    queued_event_t queued = copy_event(event);
+    if (event->event_id == MPV_EVENT_PROPERTY_CHANGE) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = merge_index.find(queued.name);
+            if (found != merge_index.end()) {
+                batch[found->second] = queued;
+                merged_count++;
+            } else {
+                merge_index[queued.name] = batch.size();
+                batch.push_back(queued);
+            }
+        }
+        properties_pending = true;
+        return;
+    }
+
+    // Fast path. Changes that come after this event must not be merged
+    // into the ones before it.
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.push_back(queued);
+        merge_index.clear();
+    }
+    post();
+}
+
+void EventThread::post() {
+    properties_pending = false;
+    last_post_ns = now_ns();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (batch.empty())
+            return;
+    }
+    // A call that is still queued picks up this batch as well.
+    if (posted.exchange(true))
+        return;
+    posted_count++;
+    QMetaObject::invokeMethod(widget, "on_mpv_events", Qt::QueuedConnection);
+}
+
+std::vector<queued_event_t> EventThread::take() {
+    std::vector<queued_event_t> events;
+    std::lock_guard<std::mutex> lock(mutex);
+    posted = false;
+    events.swap(batch);
+    merge_index.clear();
+    return events;
+}
+
+event_stats_t EventThread::stats() const {
+    return event_stats_t({
+        .received = received_count,
+        .merged = merged_count,
+        .posted = posted_count
+    });
+}
+
+void EventThread::reset_stats() {
+    received_count = 0;
+    merged_count = 0;
+    posted_count = 0;
+}
@@ -0,0 +1,96 @@
+#ifndef EVENTTHREAD_H
+#define EVENTTHREAD_H
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <QThread>
+#include <QVariant>
+#include <mpv/client.h>
+
+class MpvWidget;
+
+// An mpv event copied out of mpv's event queue, so that it stays valid after
+// the next mpv_wait_event().
+typedef struct {
+    mpv_event_id event_id;
+    int error;
+    uint64_t reply_userdata;
+    // MPV_EVENT_PROPERTY_CHANGE; format is MPV_FORMAT_NONE if the property
+    // became unavailable.
+    std::string name;
+    mpv_format format;
+    double value_double;
+    int value_flag;
+    // MPV_FORMAT_NODE, converted on the event thread.
+    QVariant value_node;
+    // MPV_EVENT_END_FILE
+    mpv_end_file_reason reason;
+} queued_event_t;
+
+typedef struct {
+    uint64_t received;
+    // Property changes replaced by a newer value before delivery.
+    uint64_t merged;
+    // Queued calls made to the GUI thread.
+    uint64_t posted;
+} event_stats_t;
+
+// Drains mpv's event queue on its own thread. Log messages go straight to
+// the log. Property changes are merged, so only the latest value of each
+// survives, and handed to the GUI thread at most once per display frame.
+// Everything else (SEEK, PLAYBACK_RESTART, END_FILE, FILE_LOADED, command
+// replies) is delivered right away, together with the property changes
+// that preceded it, so navigation never waits for the next frame.
+class EventThread : public QThread {
+    Q_OBJECT
+public:
+    EventThread(MpvWidget *widget, mpv_handle *mpv);
+    ~EventThread();
+
+    // Has to be called before mpv_terminate_destroy().
+    void stop();
+    // Any thread; 0 delivers property changes immediately.
+    void set_frame_interval(double seconds);
+
+    // GUI thread: the events collected since the last call, in order.
+    std::vector<queued_event_t> take();
+
+    event_stats_t stats() const;
+    void reset_stats();
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    // Event thread.
+    void queue(mpv_event *event);
+    void post();
+
+    MpvWidget *widget;
+    mpv_handle *mpv;
+    std::atomic<bool> quit{false};
+    std::atomic<int64_t> frame_interval_ns{16666667};
+
+    // Guards batch and merge_index.
+    std::mutex mutex;
+    std::vector<queued_event_t> batch;
+    // Position of each property in batch since the last other event;
+    // later changes overwrite it in place.
+    std::map<std::string, size_t> merge_index;
+    // Set while a call to the GUI thread is queued and not yet taken.
+    std::atomic<bool> posted{false};
+    // Property changes are waiting for the next frame.
+    bool properties_pending = false;
+    int64_t last_post_ns = 0;
+
+    std::atomic<uint64_t> received_count{0};
+    std::atomic<uint64_t> merged_count{0};
+    std::atomic<uint64_t> posted_count{0};
+};
+
+#endif // EVENTTHREAD_H
@@ -0,0 +1,40 @@
+#include "framestats.h"
+
+#include <cmath>
+
+FrameStats::FrameStats() {
+    timer.start();
+}
+
+void FrameStats::record() {
+    qint64 now = timer.nsecsElapsed();
+    if (last_ns >= 0) {
+        double interval = (now - last_ns) / 1e6;
+        count++;
+        sum += interval;
+        sum_sq += interval * interval;
+        if (interval > max)
+            max = interval;
+    }
+    last_ns = now;
+}
+
+void FrameStats::reset() {
+    count = 0;
+    sum = 0;
+    sum_sq = 0;
+    max = 0;
+}
+
+double FrameStats::mean_ms() const {
+    return count ? sum / count : 0;
+}
+
+// Standard deviation of the frame interval.
+double FrameStats::jitter_ms() const {
+    if (count < 2)
+        return 0;
+    double mean = mean_ms();
+    double variance = sum_sq / count - mean * mean;
+    return variance > 0 ? std::sqrt(variance) : 0;
+}
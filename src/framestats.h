@@ -0,0 +1,31 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <cstdint>
+#include <QElapsedTimer>
+
+// Accumulates the intervals between presented frames so that presentation
+// jitter can be compared between the GUI-thread and render-thread paths.
+class FrameStats {
+public:
+    FrameStats();
+
+    // Call once per presented (swapped) frame.
+    void record();
+    void reset();
+
+    uint64_t frames() const { return count; }
+    double mean_ms() const;
+    double jitter_ms() const;
+    double max_ms() const { return max; }
+
+private:
+    QElapsedTimer timer;
+    qint64 last_ns = -1;
+    uint64_t count = 0;
+    double sum = 0;
+    double sum_sq = 0;
+    double max = 0;
+};
+
+#endif // FRAMESTATS_H
@@ -0,0 +1,98 @@
+#include "keyframeindex.h"
+#include "bdresource.h"
+
+#include <algorithm>
+
+// ep_stream_type of the video stream's EP map.
+static const int EP_STREAM_VIDEO = 1;
+
+void KeyframeIndex::load(BLURAY *bd, uint32_t playlist, uint32_t angle, uint32_t clip_count) {
+    if (loaded && this->playlist == playlist && this->angle == angle && clips.size() == clip_count)
+        return;
+
+    clips.assign(clip_count, {});
+    size_t bytes = 0;
+    for (uint32_t i = 0; i < clip_count; i++) {
+        clpi_ptr cl(bd_get_clpi(bd, i));
+        if (!cl)
+            continue;
+        clips[i] = from_clpi(cl.get());
+        bytes += clips[i].capacity() * sizeof(keyframe_t);
+    }
+    charge.resize(bytes);
+    this->playlist = playlist;
+    this->angle = angle;
+    loaded = true;
+}
+
+void KeyframeIndex::clear() {
+    loaded = false;
+    clips.clear();
+    clips.shrink_to_fit();
+    charge.resize(0);
+}
+
+std::vector<keyframe_t> KeyframeIndex::from_clpi(const CLPI_CL *cl) {
+    const CLPI_EP_MAP_ENTRY *entry = NULL;
+    for (int i = 0; i < cl->cpi.num_stream_pid; i++) {
+        if (cl->cpi.entry[i].ep_stream_type == EP_STREAM_VIDEO) {
+            entry = &cl->cpi.entry[i];
+            break;
+        }
+    }
+    if (entry == NULL && cl->cpi.num_stream_pid > 0)
+        entry = &cl->cpi.entry[0];
+    if (entry == NULL || entry->num_ep_coarse == 0)
+        return {};
+
+    // Fine entries carry PTS bits 19..9 and the low 17 SPN bits; the
+    // coarse entry they belong to carries the rest.
+    std::vector<keyframe_t> keyframes;
+    keyframes.reserve(entry->num_ep_fine);
+    int coarse = 0;
+    uint64_t wrap = 0;
+    for (int fine = 0; fine < entry->num_ep_fine; fine++) {
+        while (coarse + 1 < entry->num_ep_coarse && (int)entry->coarse[coarse + 1].ref_ep_fine_id <= fine)
+            coarse++;
+
+        uint64_t pts = ((uint64_t)(entry->coarse[coarse].pts_ep & ~0x01) << 19) +
+                       ((uint64_t)entry->fine[fine].pts_ep << 9);
+        uint32_t spn = (entry->coarse[coarse].spn_ep & ~0x1ffff) + entry->fine[fine].spn_ep;
+
+        // Keep the index monotonic across a 33 bit PTS wrap.
+        if (!keyframes.empty() && pts + wrap + (1ULL << 32) < keyframes.back().pts)
+            wrap += 1ULL << 33;
+        keyframes.push_back(keyframe_t({ .pts = pts + wrap, .spn = spn }));
+    }
+    return keyframes;
+}
+
+bool KeyframeIndex::at_or_before(uint32_t clip, uint64_t pts, keyframe_t *keyframe) const {
+    if (clip >= clips.size() || clips[clip].empty())
+        return false;
+
+    const std::vector<keyframe_t> &keyframes = clips[clip];
+    auto next = std::upper_bound(keyframes.begin(), keyframes.end(), pts,
+        [](uint64_t pts, const keyframe_t &keyframe) { return pts < keyframe.pts; });
+    if (next == keyframes.begin())
+        return false;
+    *keyframe = *(next - 1);
+    return true;
+}
+
+bool KeyframeIndex::after(uint32_t clip, uint64_t pts, keyframe_t *keyframe) const {
+    if (clip >= clips.size())
+        return false;
+
+    const std::vector<keyframe_t> &keyframes = clips[clip];
+    auto next = std::upper_bound(keyframes.begin(), keyframes.end(), pts,
+        [](uint64_t pts, const keyframe_t &keyframe) { return pts < keyframe.pts; });
+    if (next == keyframes.end())
+        return false;
+    *keyframe = *next;
+    return true;
+}
+
+size_t KeyframeIndex::size(uint32_t clip) const {
+    return clip < clips.size() ? clips[clip].size() : 0;
+}
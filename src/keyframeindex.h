@@ -0,0 +1,45 @@
+#ifndef KEYFRAMEINDEX_H
+#define KEYFRAMEINDEX_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <libbluray/bluray.h>
+#include <libbluray/clpi_data.h>
+
+#include "memstats.h"
+
+typedef struct {
+    uint64_t pts; // 90 kHz, stream time of the clip
+    uint32_t spn; // source packet number, byte offset is spn * 192
+} keyframe_t;
+
+// Keyframes of every clip in a playlist, from the EP maps of the clip info
+// files. These list each I-frame that can start decoding, so seeks can go
+// straight to a keyframe instead of mpv probing the transport stream.
+class KeyframeIndex {
+public:
+    // Reads the EP maps of the clips of libbluray's current title, unless
+    // that playlist and angle are already loaded.
+    void load(BLURAY *bd, uint32_t playlist, uint32_t angle, uint32_t clip_count);
+    void clear();
+
+    // Last keyframe at or before pts (clip stream time) in O(log n). False
+    // if the clip has no EP map or pts is before its first entry.
+    bool at_or_before(uint32_t clip, uint64_t pts, keyframe_t *keyframe) const;
+    // First keyframe after pts. False if there is none.
+    bool after(uint32_t clip, uint64_t pts, keyframe_t *keyframe) const;
+    size_t size(uint32_t clip) const;
+
+    static std::vector<keyframe_t> from_clpi(const CLPI_CL *cl);
+
+private:
+    bool loaded = false;
+    uint32_t playlist = 0;
+    uint32_t angle = 0;
+    std::vector<std::vector<keyframe_t>> clips;
+    MemCharge charge{MEM_KEYFRAME_INDEX};
+};
+
+#endif // KEYFRAMEINDEX_H
@@ -0,0 +1,355 @@
+#include "libraryscanner.h"
+#include "bdresource.h"
+#include "discio.h"
+#include "log.h"
+
+#include <memory>
+#include <cstring>
+#include <strings.h>
+#include <filesystem>
+#include <algorithm>
+
+#include <libbluray/bluray.h>
+
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QThread>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QtConcurrent/QtConcurrentMap>
+
+namespace fs = std::filesystem;
+
+static const int INDEX_VERSION = 1;
+
+static qint64 mtime_ms(const fs::path &path, std::error_code &ec) {
+    auto time = fs::last_write_time(path, ec);
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+static bool is_iso(const fs::path &path) {
+    QString ext = QString::fromStdString(path.extension().string());
+    return ext.compare(".iso", Qt::CaseInsensitive) == 0;
+}
+
+static void fnv1a(uint64_t *hash, const void *data, size_t size) {
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++) {
+        *hash ^= p[i];
+        *hash *= 0x100000001b3ULL;
+    }
+}
+
+static QStringList languages(const BLURAY_STREAM_INFO *streams, uint8_t count) {
+    QStringList langs;
+    for (uint8_t i = 0; i < count; i++)
+        langs << QString::fromLatin1((const char *)streams[i].lang);
+    return langs;
+}
+
+LibraryScanner::LibraryScanner(const QString &index_path, int workers):
+    index_path(index_path), workers(workers > 0 ? workers : QThread::idealThreadCount()) {}
+
+bool LibraryScanner::is_disc(const QString &path) {
+    std::error_code ec;
+    fs::path p = path.toStdString();
+    if (fs::is_regular_file(p, ec))
+        return is_iso(p);
+    return fs::exists(p / "BDMV", ec) || (p.filename() == "BDMV" && fs::exists(p / "index.bdmv", ec));
+}
+
+bool LibraryScanner::load() {
+    QFile file(index_path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    if (root["version"].toInt() != INDEX_VERSION)
+        return false;
+
+    index.clear();
+    for (const QJsonValue &value : root["discs"].toArray()) {
+        QJsonObject object = value.toObject();
+        library_disc_t disc({
+            .path = object["path"].toString(),
+            .name = object["name"].toString(),
+            .disc_id = object["disc_id"].toString(),
+            .fingerprint = object["fingerprint"].toString(),
+            .mtime = object["mtime"].toInteger(),
+            .size = object["size"].toInteger(),
+            .titles = {}
+        });
+        for (const QJsonValue &title_value : object["titles"].toArray()) {
+            QJsonObject title = title_value.toObject();
+            disc.titles.push_back(library_title_t({
+                .playlist = (uint32_t)title["playlist"].toInteger(),
+                .duration = (uint64_t)title["duration"].toInteger(),
+                .chapters = (uint32_t)title["chapters"].toInteger(),
+                .angles = (uint32_t)title["angles"].toInteger(),
+                .audio = title["audio"].toVariant().toStringList(),
+                .subtitles = title["subtitles"].toVariant().toStringList()
+            }));
+        }
+        index[disc.path] = disc;
+    }
+    return true;
+}
+
+bool LibraryScanner::save() const {
+    QJsonArray discs;
+    for (const auto &[path, disc] : index) {
+        QJsonArray titles;
+        for (const library_title_t &title : disc.titles) {
+            titles.append(QJsonObject({
+                {"playlist", (qint64)title.playlist},
+                {"duration", (qint64)title.duration},
+                {"chapters", (qint64)title.chapters},
+                {"angles", (qint64)title.angles},
+                {"audio", QJsonArray::fromStringList(title.audio)},
+                {"subtitles", QJsonArray::fromStringList(title.subtitles)}
+            }));
+        }
+        discs.append(QJsonObject({
+            {"path", disc.path},
+            {"name", disc.name},
+            {"disc_id", disc.disc_id},
+            {"fingerprint", disc.fingerprint},
+            {"mtime", disc.mtime},
+            {"size", disc.size},
+            {"titles", titles}
+        }));
+    }
+
+    QSaveFile file(index_path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    QJsonObject root({{"version", INDEX_VERSION}, {"discs", discs}});
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+library_scan_stats_t LibraryScanner::scan(const QString &root) {
+    library_scan_stats_t stats = {};
+    QElapsedTimer timer;
+    timer.start();
+
+    // Collect candidates without opening anything.
+    // Errors on single entries skip them; an error of the walk itself ends
+    // it early.
+    std::vector<library_disc_t> candidates;
+    std::error_code ec, walk_ec;
+    auto it = fs::recursive_directory_iterator(root.toStdString(),
+        fs::directory_options::skip_permission_denied, walk_ec);
+    for (; !walk_ec && it != fs::recursive_directory_iterator(); it.increment(walk_ec)) {
+        fs::path path = it->path();
+        fs::path key;
+
+        if (it->is_directory(ec) && path.filename() == "BDMV") {
+            it.disable_recursion_pending();
+            key = path / "index.bdmv";
+            if (!fs::exists(key, ec)) continue;
+            path = path.parent_path();
+        } else if (it->is_regular_file(ec) && is_iso(path)) {
+            key = path;
+        } else {
+            continue;
+        }
+
+        candidates.push_back(library_disc_t({
+            .path = QString::fromStdString(path.string()),
+            .name = QString(),
+            .disc_id = QString(),
+            .fingerprint = QString(),
+            .mtime = mtime_ms(key, ec),
+            .size = (qint64)fs::file_size(key, ec),
+            .titles = {}
+        }));
+    }
+    stats.found = candidates.size();
+    if (walk_ec) {
+        stats.incomplete = true;
+        Log::write(LOG_LEVEL_ERROR, "library", "Scan of %s stopped: %s",
+            root.toLocal8Bit().data(), walk_ec.message().c_str());
+    }
+
+    std::map<QString, library_disc_t> previous;
+    previous.swap(index);
+
+    // Unchanged discs keep their entry; changed ones are rescanned.
+    std::vector<library_disc_t> todo;
+    for (library_disc_t &candidate : candidates) {
+        auto found = previous.find(candidate.path);
+        if (found == previous.end()) {
+            todo.push_back(candidate);
+            continue;
+        }
+        if (found->second.mtime == candidate.mtime && found->second.size == candidate.size) {
+            index[candidate.path] = found->second;
+            stats.unchanged++;
+        } else {
+            todo.push_back(candidate);
+        }
+        previous.erase(found);
+    }
+
+    // What is left in previous has vanished from its path; a new candidate
+    // with the same change key may be the same disc moved or renamed. Discs
+    // of a box set often carry identical index.bdmv files, so the match is
+    // only taken if the navigation files hash the same as well.
+    todo.erase(std::remove_if(todo.begin(), todo.end(), [&](const library_disc_t &candidate) {
+        QString candidate_fingerprint;
+        bool hashed = false;
+        for (auto moved = previous.begin(); moved != previous.end(); moved++) {
+            if (moved->second.mtime != candidate.mtime || moved->second.size != candidate.size ||
+                moved->second.fingerprint.isEmpty())
+                continue;
+            if (!hashed) {
+                candidate_fingerprint = fingerprint(candidate.path);
+                hashed = true;
+            }
+            if (candidate_fingerprint != moved->second.fingerprint)
+                continue;
+            library_disc_t disc = moved->second;
+            disc.path = candidate.path;
+            index[disc.path] = disc;
+            previous.erase(moved);
+            stats.moved++;
+            return true;
+        }
+        return false;
+    }), todo.end());
+
+    // Discs the walk did not get to are not known to be gone.
+    if (stats.incomplete) {
+        for (auto &[path, disc] : previous) {
+            if (fs::exists(path.toStdString(), ec))
+                index[path] = disc;
+        }
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(workers);
+    std::vector<uint8_t> ok(todo.size());
+    std::vector<size_t> jobs(todo.size());
+    for (size_t i = 0; i < jobs.size(); i++)
+        jobs[i] = i;
+    QtConcurrent::blockingMap(&pool, jobs, [&](size_t i) {
+        ok[i] = scan_disc(todo[i]);
+    });
+
+    for (size_t i = 0; i < todo.size(); i++) {
+        if (ok[i]) {
+            index[todo[i].path] = todo[i];
+            stats.scanned++;
+        } else {
+            stats.failed++;
+        }
+    }
+
+    stats.seconds = timer.nsecsElapsed() / 1e9;
+    // Throughput of the discs that actually had to be opened.
+    stats.discs_per_sec = stats.seconds > 0 ? (stats.scanned + stats.failed) / stats.seconds : 0;
+    return stats;
+}
+
+// Runs on a pool thread with its own BLURAY instance.
+bool LibraryScanner::scan_disc(library_disc_t &disc) {
+    bd_ptr bd(bd_open(disc.path.toLocal8Bit().data(), NULL));
+    if (bd == NULL)
+        return false;
+
+    const BLURAY_DISC_INFO *disc_info = bd_get_disc_info(bd.get());
+    if (!disc_info || !disc_info->bluray_detected)
+        return false;
+
+    if (disc_info->disc_name && *disc_info->disc_name)
+        disc.name = QString::fromUtf8(disc_info->disc_name);
+    else if (disc_info->udf_volume_id && *disc_info->udf_volume_id)
+        disc.name = QString::fromUtf8(disc_info->udf_volume_id);
+    else
+        disc.name = QFileInfo(disc.path).completeBaseName();
+
+    QByteArray disc_id((const char *)disc_info->disc_id, sizeof(disc_info->disc_id));
+    disc.disc_id = disc_id.count('\0') == disc_id.size() ? QString() : QString::fromLatin1(disc_id.toHex());
+
+    disc.fingerprint = fingerprint(disc.path);
+
+    disc.titles.clear();
+    uint32_t title_count = bd_get_titles(bd.get(), TITLES_RELEVANT, 0);
+    for (uint32_t i = 0; i < title_count; i++) {
+        title_info_ptr title_info(bd_get_title_info(bd.get(), i, 0));
+        if (title_info == NULL) continue;
+
+        library_title_t title({
+            .playlist = title_info->playlist,
+            .duration = title_info->duration,
+            .chapters = title_info->chapter_count,
+            .angles = title_info->angle_count,
+            .audio = {},
+            .subtitles = {}
+        });
+        if (title_info->clip_count) {
+            const BLURAY_CLIP_INFO &clip = title_info->clips[0];
+            title.audio = languages(clip.audio_streams, clip.audio_stream_count);
+            title.subtitles = languages(clip.pg_streams, clip.pg_stream_count);
+        }
+        disc.titles.push_back(title);
+    }
+    return true;
+}
+
+std::vector<const library_disc_t *> LibraryScanner::query(const QString &text) const {
+    std::vector<const library_disc_t *> matches;
+    for (const auto &[path, disc] : index) {
+        bool match = disc.name.contains(text, Qt::CaseInsensitive) || path.contains(text, Qt::CaseInsensitive);
+        for (size_t i = 0; !match && i < disc.titles.size(); i++) {
+            match = disc.titles[i].audio.contains(text, Qt::CaseInsensitive) ||
+                    disc.titles[i].subtitles.contains(text, Qt::CaseInsensitive);
+        }
+        if (match)
+            matches.push_back(&disc);
+    }
+    return matches;
+}
+
+// Hash of index.bdmv, MovieObject.bdmv and the playlists, read through
+// DiscIO so that ISO images work without mounting. Empty if none of them
+// can be read.
+QString LibraryScanner::fingerprint(const QString &path) {
+    std::unique_ptr<DiscIO> io(DiscIO::open(path));
+    if (io == NULL)
+        return QString();
+
+    std::vector<std::string> files = { "BDMV/index.bdmv", "BDMV/MovieObject.bdmv" };
+    std::vector<std::string> playlists;
+    BD_DIR_H *dir = io->open_dir("BDMV/PLAYLIST");
+    if (dir != NULL) {
+        BD_DIRENT entry;
+        while (dir->read(dir, &entry) == 0) {
+            if (strlen(entry.d_name) == 10 && !strcasecmp(entry.d_name + 5, ".mpls"))
+                playlists.push_back(std::string("BDMV/PLAYLIST/") + entry.d_name);
+        }
+        dir->close(dir);
+    }
+    std::sort(playlists.begin(), playlists.end());
+    files.insert(files.end(), playlists.begin(), playlists.end());
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t hashed = 0;
+    std::vector<uint8_t> buffer(64 * 1024);
+    for (const std::string &file : files) {
+        BD_FILE_H *fp = io->open_file(file.c_str());
+        if (fp == NULL)
+            continue;
+        fnv1a(&hash, file.data(), file.size());
+        int64_t n;
+        while ((n = fp->read(fp, buffer.data(), buffer.size())) > 0)
+            fnv1a(&hash, buffer.data(), n);
+        fp->close(fp);
+        hashed++;
+    }
+    return hashed ? QString::number(hash, 16) : QString();
+}
@@ -0,0 +1,75 @@
+#ifndef LIBRARYSCANNER_H
+#define LIBRARYSCANNER_H
+
+#include <map>
+#include <vector>
+#include <cstdint>
+
+#include <QString>
+#include <QStringList>
+
+typedef struct {
+    uint32_t playlist;
+    uint64_t duration; // 90 kHz
+    uint32_t chapters;
+    uint32_t angles;
+    QStringList audio;
+    QStringList subtitles;
+} library_title_t;
+
+typedef struct {
+    QString path;
+    QString name;
+    QString disc_id;
+    // Hash of the navigation files, confirming that a disc was moved.
+    QString fingerprint;
+    // Change detection: index.bdmv (folders) or the image file (ISO).
+    qint64 mtime;
+    qint64 size;
+    std::vector<library_title_t> titles;
+} library_disc_t;
+
+typedef struct {
+    uint32_t found;
+    uint32_t scanned;
+    uint32_t unchanged;
+    uint32_t moved;
+    uint32_t failed;
+    // The walk stopped at an I/O error; discs it did not reach were kept.
+    bool incomplete;
+    double seconds;
+    double discs_per_sec;
+} library_scan_stats_t;
+
+// Walks a directory tree for BDMV folders and ISO images and keeps an on-disk
+// JSON index of their titles. Discs are opened in parallel on a bounded
+// thread pool, one BLURAY instance per task. Rescans are incremental: discs
+// whose index.bdmv/image is unchanged keep their entry, and discs that were
+// only moved are matched by their change key and navigation files instead
+// of being reopened.
+class LibraryScanner {
+public:
+    explicit LibraryScanner(const QString &index_path, int workers = 0);
+
+    bool load();
+    bool save() const;
+    library_scan_stats_t scan(const QString &root);
+
+    // Discs whose name or path contains text, or that have a title with an
+    // audio/subtitle stream in that language (ISO 639-2, e.g. "eng").
+    std::vector<const library_disc_t *> query(const QString &text) const;
+    const std::map<QString, library_disc_t> &discs() const { return index; }
+
+    // BDMV folder (or its parent) or ISO image.
+    static bool is_disc(const QString &path);
+
+private:
+    static bool scan_disc(library_disc_t &disc);
+    static QString fingerprint(const QString &path);
+
+    QString index_path;
+    int workers;
+    std::map<QString, library_disc_t> index;
+};
+
+#endif // LIBRARYSCANNER_H
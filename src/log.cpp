@@ -0,0 +1,302 @@
+#include "log.h"
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <condition_variable>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+// Power of two; 256 byte slots, so 1 MiB of history.
+static const uint64_t RING_SIZE = 4096;
+static const auto FLUSH_INTERVAL = std::chrono::milliseconds(100);
+
+typedef struct {
+    // 2n + 1 while record n is written, 2n + 2 once it is complete.
+    std::atomic<uint64_t> seq;
+    uint64_t time_ns;
+    int32_t level;
+    char category[16];
+    char text[220];
+} slot_t;
+
+typedef struct {
+    uint64_t time_ns;
+    int32_t level;
+    char category[16];
+    char text[220];
+} record_t;
+
+typedef enum { READ_OK, READ_PENDING, READ_LOST } read_result_t;
+
+static slot_t ring[RING_SIZE];
+static std::atomic<uint64_t> head{0};
+static const auto epoch = std::chrono::steady_clock::now();
+
+static int sink_fd = STDERR_FILENO;
+static log_level_t sink_level = LOG_LEVEL_INFO;
+static std::thread flusher;
+static std::atomic<bool> running{false};
+static std::atomic<bool> dump_requested{false};
+static std::mutex wake_mutex;
+static std::condition_variable wake;
+
+void Log::write(log_level_t level, const char *category, const char *format, ...) {
+    uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+    slot_t &slot = ring[index & (RING_SIZE - 1)];
+
+    slot.seq.store(index * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch).count();
+    slot.level = level;
+    strncpy(slot.category, category, sizeof(slot.category) - 1);
+    slot.category[sizeof(slot.category) - 1] = '\0';
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(slot.text, sizeof(slot.text), format, args);
+    va_end(args);
+
+    slot.seq.store(index * 2 + 2, std::memory_order_release);
+
+    // Errors should not wait for the next flush interval.
+    if (level <= LOG_LEVEL_ERROR && running)
+        wake.notify_one();
+}
+
+// Copies record index out of its slot, unless it is still being written or
+// has already been overwritten by a newer one.
+static read_result_t read_record(uint64_t index, record_t *record) {
+    slot_t &slot = ring[index & (RING_SIZE - 1)];
+    uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq < index * 2 + 2)
+        return READ_PENDING;
+    if (seq > index * 2 + 2)
+        return READ_LOST;
+
+    record->time_ns = slot.time_ns;
+    record->level = slot.level;
+    memcpy(record->category, slot.category, sizeof(record->category));
+    memcpy(record->text, slot.text, sizeof(record->text));
+    record->category[sizeof(record->category) - 1] = '\0';
+    record->text[sizeof(record->text) - 1] = '\0';
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.seq.load(std::memory_order_relaxed) == seq ? READ_OK : READ_LOST;
+}
+
+static const char *level_name(int level) {
+    switch (level) {
+        case LOG_LEVEL_FATAL: return "fatal";
+        case LOG_LEVEL_ERROR: return "error";
+        case LOG_LEVEL_WARN:  return "warn";
+        case LOG_LEVEL_INFO:  return "info";
+        case LOG_LEVEL_V:     return "v";
+        case LOG_LEVEL_DEBUG: return "debug";
+        default:              return "trace";
+    }
+}
+
+static size_t append(char *out, size_t pos, size_t size, const char *text, size_t width = 0) {
+    size_t start = pos;
+    for (; *text && pos + 1 < size; text++)
+        out[pos++] = *text;
+    while (pos - start < width && pos + 1 < size)
+        out[pos++] = ' ';
+    return pos;
+}
+
+static size_t append_number(char *out, size_t pos, size_t size, uint64_t value, int digits) {
+    char buf[24];
+    int n = 0;
+    do {
+        buf[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value || n < digits);
+    while (n > 0 && pos + 1 < size)
+        out[pos++] = buf[--n];
+    return pos;
+}
+
+// "[  12.345] info  mpv/cplayer  text\n", without stdio so that it can be
+// used from a signal handler.
+static size_t format_record(const record_t &record, char *out, size_t size) {
+    uint64_t ms = record.time_ns / 1000000;
+    size_t pos = append(out, 0, size, "[");
+    char seconds[24];
+    size_t digits = append_number(seconds, 0, sizeof(seconds), ms / 1000, 1);
+    seconds[digits] = '\0';
+    for (size_t i = digits; i < 5; i++)
+        pos = append(out, pos, size, " ");
+    pos = append(out, pos, size, seconds);
+    pos = append(out, pos, size, ".");
+    pos = append_number(out, pos, size, ms % 1000, 3);
+    pos = append(out, pos, size, "] ");
+    pos = append(out, pos, size, level_name(record.level), 6);
+    pos = append(out, pos, size, record.category, 13);
+
+    // Drop trailing newlines, mpv messages come with one.
+    size_t text = strlen(record.text);
+    while (text > 0 && record.text[text - 1] == '\n')
+        text--;
+    for (size_t i = 0; i < text && pos + 2 < size; i++)
+        out[pos++] = record.text[i];
+    out[pos++] = '\n';
+    return pos;
+}
+
+static void write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n <= 0)
+            return;
+        data += n;
+        size -= n;
+    }
+}
+
+void Log::dump(int fd) {
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t index = end > RING_SIZE ? end - RING_SIZE : 0;
+    for (; index < end; index++) {
+        record_t record;
+        if (read_record(index, &record) != READ_OK)
+            continue;
+        char line[320];
+        write_all(fd, line, format_record(record, line, sizeof(line)));
+    }
+}
+
+// Writes new records at or above the sink level; returns where to resume.
+static uint64_t flush_from(uint64_t next) {
+    static char buffer[64 * 1024];
+    size_t used = 0;
+    uint64_t lost = 0;
+
+    uint64_t end = head.load(std::memory_order_acquire);
+    if (end - next > RING_SIZE) {
+        lost += end - RING_SIZE - next;
+        next = end - RING_SIZE;
+    }
+    for (; next < end; next++) {
+        record_t record;
+        read_result_t result = read_record(next, &record);
+        if (result == READ_PENDING)
+            break;
+        if (result == READ_LOST) {
+            lost++;
+            continue;
+        }
+        if (record.level > sink_level)
+            continue;
+        if (used + 320 > sizeof(buffer)) {
+            write_all(sink_fd, buffer, used);
+            used = 0;
+        }
+        used += format_record(record, buffer + used, sizeof(buffer) - used);
+    }
+    write_all(sink_fd, buffer, used);
+
+    if (lost) {
+        char line[80];
+        int n = snprintf(line, sizeof(line), "[log] %llu records overwritten before flushing\n",
+                         (unsigned long long)lost);
+        write_all(sink_fd, line, n);
+    }
+    return next;
+}
+
+static void flush_loop() {
+    uint64_t next = 0;
+    while (true) {
+        bool stopping = !running;
+        next = flush_from(next);
+        if (dump_requested.exchange(false)) {
+            static const char header[] = "--- log dump ---\n";
+            write_all(sink_fd, header, sizeof(header) - 1);
+            Log::dump(sink_fd);
+        }
+        if (stopping)
+            break;
+
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake.wait_for(lock, FLUSH_INTERVAL);
+    }
+}
+
+static void on_crash(int sig) {
+    static const char header[] = "\n--- crashed, last log records ---\n";
+    write_all(STDERR_FILENO, header, sizeof(header) - 1);
+    Log::dump(STDERR_FILENO);
+    if (sink_fd != STDERR_FILENO) {
+        write_all(sink_fd, header, sizeof(header) - 1);
+        Log::dump(sink_fd);
+    }
+    // The handler was reset on entry; crash for real.
+    raise(sig);
+}
+
+static void on_dump_request(int sig) {
+    (void)sig;
+    dump_requested = true;
+}
+
+log_level_t Log::parse_level(const char *name, log_level_t fallback) {
+    static const log_level_t levels[] = {
+        LOG_LEVEL_FATAL, LOG_LEVEL_ERROR, LOG_LEVEL_WARN, LOG_LEVEL_INFO,
+        LOG_LEVEL_V, LOG_LEVEL_DEBUG, LOG_LEVEL_TRACE
+    };
+    if (name == NULL)
+        return fallback;
+    for (log_level_t level : levels)
+        if (!strcmp(name, level_name(level)))
+            return level;
+    return fallback;
+}
+
+void Log::start() {
+    if (running)
+        return;
+
+    QByteArray path = qgetenv("MPV_BD_LOG");
+    if (!path.isEmpty()) {
+        int fd = open(path.constData(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd >= 0)
+            sink_fd = fd;
+    }
+    QByteArray level = qgetenv("MPV_BD_LOG_LEVEL");
+    sink_level = parse_level(level.isEmpty() ? NULL : level.constData(), LOG_LEVEL_INFO);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_crash;
+    action.sa_flags = SA_RESETHAND | SA_NODEFER;
+    for (int sig : {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT})
+        sigaction(sig, &action, NULL);
+    action.sa_handler = on_dump_request;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+
+    running = true;
+    flusher = std::thread(flush_loop);
+}
+
+void Log::stop() {
+    if (!running)
+        return;
+    running = false;
+    wake.notify_one();
+    flusher.join();
+    if (sink_fd != STDERR_FILENO) {
+        close(sink_fd);
+        sink_fd = STDERR_FILENO;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <QtGlobal>
+
+// Same values as mpv_log_level, so mpv messages map directly.
+typedef enum {
+    LOG_LEVEL_FATAL = 10,
+    LOG_LEVEL_ERROR = 20,
+    LOG_LEVEL_WARN  = 30,
+    LOG_LEVEL_INFO  = 40,
+    LOG_LEVEL_V     = 50,
+    LOG_LEVEL_DEBUG = 60,
+    LOG_LEVEL_TRACE = 70,
+} log_level_t;
+
+// Structured log kept in a fixed in-memory ring buffer. Writers never block
+// or touch the terminal: a record is formatted into the next slot and
+// published with a sequence number. A flusher thread writes records to the
+// sink in the background, so verbose diagnostics can stay enabled while
+// playing. The last records are dumped on a crash or on SIGUSR1.
+class Log {
+public:
+    // Starts the flusher. MPV_BD_LOG=<file> redirects it from stderr,
+    // MPV_BD_LOG_LEVEL=error|warn|info|v|debug|trace selects what it writes
+    // (default info); the ring buffer keeps every level.
+    static void start();
+    // Flushes what is left and stops the flusher.
+    static void stop();
+
+    static void write(log_level_t level, const char *category, const char *format, ...)
+        Q_ATTRIBUTE_FORMAT_PRINTF(3, 4);
+
+    // Writes every record still in the ring buffer. Async-signal-safe.
+    static void dump(int fd);
+
+    static log_level_t parse_level(const char *name, log_level_t fallback);
+};
+
+#endif // LOG_H
@@ -1,13 +1,144 @@
 #include <locale.h>
+#include <cstring>
+#include <cstdlib>
 #include <QApplication>
 #include "mainwindow.h"
+#include "libraryscanner.h"
+#include "titleexporter.h"
+#include "log.h"
+
+// mpv_bd --scan <root> [index] [workers]
+// mpv_bd --query <index> <text>
+static int library_main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+
+    if (!strcmp(argv[1], "--scan")) {
+        QString root = QString::fromLocal8Bit(argv[2]);
+        QString index = argc > 3 ? QString::fromLocal8Bit(argv[3]) : root + "/.mpv_bd_index.json";
+        LibraryScanner scanner(index, argc > 4 ? atoi(argv[4]) : 0);
+        scanner.load();
+
+        library_scan_stats_t stats = scanner.scan(root);
+        printf("%u discs found, %u scanned, %u unchanged, %u moved, %u failed in %.2f s (%.1f discs/sec)\n",
+            stats.found, stats.scanned, stats.unchanged, stats.moved, stats.failed,
+            stats.seconds, stats.discs_per_sec);
+        if (stats.incomplete)
+            printf("Scan stopped early, discs not reached were kept\n");
+
+        if (!scanner.save()) {
+            printf("Could not write %s\n", index.toLocal8Bit().data());
+            return 1;
+        }
+        return 0;
+    }
+
+    LibraryScanner scanner(QString::fromLocal8Bit(argv[2]));
+    if (argc < 4 || !scanner.load()) {
+        printf("Could not read %s\n", argv[2]);
+        return 1;
+    }
+    for (const library_disc_t *disc : scanner.query(QString::fromLocal8Bit(argv[3]))) {
+        printf("%s (%s)\n", disc->name.toUtf8().data(), disc->path.toUtf8().data());
+        for (const library_title_t &title : disc->titles) {
+            uint64_t sec = title.duration / 90000;
+            printf("  %05u.mpls %02u:%02u:%02u %3u chapters  audio: %s  subtitles: %s\n",
+                title.playlist, (unsigned)(sec / 3600), (unsigned)(sec / 60 % 60), (unsigned)(sec % 60),
+                title.chapters, title.audio.join(",").toUtf8().data(), title.subtitles.join(",").toUtf8().data());
+        }
+    }
+    return 0;
+}
+
+// mpv_bd --export [-j workers] [-a audio] [-s subtitles] <disc>[:playlist] <output> ...
+static int export_main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    // libmpv requires LC_NUMERIC "C", see main().
+    setlocale(LC_NUMERIC, "C");
+
+    int workers = 0;
+    QString audio, subtitles;
+    std::vector<export_job_t> jobs;
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-a") && i + 1 < argc) {
+            audio = QString::fromLocal8Bit(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            subtitles = QString::fromLocal8Bit(argv[++i]);
+        } else if (i + 1 < argc) {
+            export_job_t job({
+                .disc = QString::fromLocal8Bit(argv[i]),
+                .output = QString::fromLocal8Bit(argv[i + 1]),
+                .main_feature = true,
+                .playlist = 0,
+                .audio = QString(),
+                .subtitles = QString()
+            });
+            // A trailing :<number> picks the playlist instead of the main feature.
+            int colon = job.disc.lastIndexOf(':');
+            bool number = false;
+            uint32_t playlist = colon > 0 ? job.disc.mid(colon + 1).toUInt(&number) : 0;
+            if (number) {
+                job.disc.truncate(colon);
+                job.main_feature = false;
+                job.playlist = playlist;
+            }
+            jobs.push_back(job);
+            i++;
+        } else {
+            printf("Missing output for %s\n", argv[i]);
+            return 1;
+        }
+    }
+    for (export_job_t &job : jobs) {
+        job.audio = audio;
+        job.subtitles = subtitles;
+    }
+
+    Log::start();
+    std::vector<export_result_t> results = TitleExporter(workers).run(jobs);
+    Log::stop();
+
+    int failed = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const export_result_t &result = results[i];
+        if (!result.ok) {
+            printf("%s: failed: %s\n", jobs[i].disc.toLocal8Bit().data(), result.error.toLocal8Bit().data());
+            failed++;
+            continue;
+        }
+        uint64_t sec = result.duration / 90000;
+        printf("%s: %05u.mpls %02u:%02u:%02u %u clips %u chapters -> %s  %.1f MB in %.1f s (%.1f MB/s)\n",
+            jobs[i].disc.toLocal8Bit().data(), result.playlist,
+            (unsigned)(sec / 3600), (unsigned)(sec / 60 % 60), (unsigned)(sec % 60),
+            result.clips, result.chapters, jobs[i].output.toLocal8Bit().data(),
+            result.bytes / 1e6, result.seconds, result.mb_per_s);
+    }
+    return failed ? 1 : 0;
+}
 
 int main(int argc, char *argv[]) {
+    if (argc > 2 && (!strcmp(argv[1], "--scan") || !strcmp(argv[1], "--query"))) {
+        // DiscIO reports unreadable images and I/O stats through the log.
+        Log::start();
+        int ret = library_main(argc, argv);
+        Log::stop();
+        return ret;
+    }
+    if (argc > 2 && !strcmp(argv[1], "--export"))
+        return export_main(argc, argv);
+
     QApplication a(argc, argv);
     // Qt sets the locale in the QApplication constructor, but libmpv requires
     // the LC_NUMERIC category to be set to "C", so change it back.
     setlocale(LC_NUMERIC, "C");
-    MainWindow w;
-    w.show();
-    return a.exec();
+    Log::start();
+    int ret;
+    {
+        MainWindow w;
+        w.show();
+        ret = a.exec();
+    }
+    Log::stop();
+    return ret;
 }
@@ -1,48 +1,72 @@
 #include "mainwindow.h"
+#include "libraryscanner.h"
+#include "swvideoview.h"
 #include <iostream>
 
 MainWindow::MainWindow(QWidget *parent) : QWidget(parent) {
-    m_mpv = new MpvWidget(this);
+    // With the software backend the player stays off-screen and a plain
+    // widget shows its frames, so that the window needs no OpenGL.
+    bool software = MpvWidget::software_rendering();
+    m_mpv = new MpvWidget(software ? nullptr : this);
+    QWidget *video = m_mpv;
+    if (software)
+        video = new SwVideoView(m_mpv);
     m_slider = new QSlider();
     m_slider->setOrientation(Qt::Horizontal);
     m_openBtn = new QPushButton("Open");
     m_playBtn = new QPushButton("Pause");
     m_firstPlayBox = new QCheckBox("Skip First Play");
     m_firstPlayBox->setCheckState(Qt::Checked);
+    m_mainFeatureBox = new QCheckBox("Main Feature");
     m_menuBtn = new QPushButton("Main Menu");
     m_popupBtn = new QPushButton("Popup Menu");
     m_popupBtn->setVisible(false);
     hb = new QHBoxLayout();
     hb->addWidget(m_openBtn);
     hb->addWidget(m_firstPlayBox);
+    hb->addWidget(m_mainFeatureBox);
     hb->addWidget(m_playBtn);
     hb->addWidget(m_popupBtn);
     QVBoxLayout *vl = new QVBoxLayout();
-    vl->addWidget(m_mpv);
+    vl->addWidget(video);
     vl->addWidget(m_slider);
     vl->addLayout(hb);
     setLayout(vl);
     connect(m_slider, SIGNAL(sliderMoved(int)), SLOT(seek(int)));
+    connect(m_slider, SIGNAL(sliderReleased()), SLOT(seekExact()));
     connect(m_openBtn, SIGNAL(clicked()), SLOT(openMedia()));
     connect(m_playBtn, SIGNAL(clicked()), SLOT(pauseResume()));
     connect(m_menuBtn, SIGNAL(clicked()), SLOT(openMenu()));
     connect(m_popupBtn, SIGNAL(clicked()), SLOT(openPopup()));
-    connect(m_mpv, SIGNAL(positionChanged(int)), m_slider, SLOT(setValue(int)));
+    connect(m_mpv, SIGNAL(positionChanged(int)), this, SLOT(setSliderPosition(int)));
     connect(m_mpv, SIGNAL(durationChanged(int)), this, SLOT(setSliderRange(int)));
     connect(m_mpv, SIGNAL(menuButton(bool)), this, SLOT(setMenuButton(bool)));
     connect(m_mpv, SIGNAL(popupButton(bool)), this, SLOT(setPopupButton(bool)));
 }
 
+MainWindow::~MainWindow() {
+    // Not a child without a GL view, see the constructor.
+    if (!m_mpv->parent())
+        delete m_mpv;
+}
+
 void MainWindow::openMedia() {
     QString dir = QFileDialog::getExistingDirectory(0, "Open disc", "/Users/brianhvo02/Desktop/Volume 1", QFileDialog::ShowDirsOnly);
-    if (dir.isEmpty() || !std::filesystem::exists(dir.toStdString() + "/BDMV"))
+    if (dir.isEmpty() || !LibraryScanner::is_disc(dir))
         return;
-    m_mpv->open_disc(dir, m_firstPlayBox->checkState() == Qt::Checked);
-    hb->addWidget(m_menuBtn);
+    bool main_feature = m_mainFeatureBox->checkState() == Qt::Checked;
+    m_mpv->open_disc(dir, m_firstPlayBox->checkState() == Qt::Checked, main_feature);
+    if (!main_feature)
+        hb->addWidget(m_menuBtn);
 }
 
 void MainWindow::seek(int pos) {
-    m_mpv->command(QVariantList() << "seek" << pos << "absolute");
+    // Keyframe seeks while dragging, see seekExact() for the final position.
+    m_mpv->seek_title(pos, false);
+}
+
+void MainWindow::seekExact() {
+    m_mpv->seek_title(m_slider->value(), true);
 }
 
 void MainWindow::pauseResume() {
@@ -62,6 +86,12 @@ void MainWindow::setSliderRange(int duration) {
     m_slider->setRange(0, duration);
 }
 
+void MainWindow::setSliderPosition(int pos) {
+    // Don't fight the user over the handle while a drag is in progress.
+    if (!m_slider->isSliderDown())
+        m_slider->setValue(pos);
+}
+
 void MainWindow::setMenuButton(bool value) {
     m_menuBtn->setVisible(value);
 }
@@ -17,9 +17,11 @@ class MainWindow : public QWidget {
     Q_OBJECT
 public:
     explicit MainWindow(QWidget *parent = 0);
+    ~MainWindow();
 public Q_SLOTS:
     void openMedia();
     void seek(int pos);
+    void seekExact();
     void pauseResume();
     void openMenu();
     void openPopup();
@@ -27,6 +29,7 @@ private Q_SLOTS:
     void setMenuButton(bool value);
     void setPopupButton(bool value);
     void setSliderRange(int duration);
+    void setSliderPosition(int pos);
 private:
     MpvWidget *m_mpv;
     QHBoxLayout *hb;
@@ -37,6 +40,7 @@ private:
     QPushButton *m_menuBtn;
     QPushButton *m_popupBtn;
     QCheckBox *m_firstPlayBox;
+    QCheckBox *m_mainFeatureBox;
 };
 
 #endif // MainWindow_H
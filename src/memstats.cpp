@@ -0,0 +1,86 @@
+#include "memstats.h"
+#include "log.h"
+
+#include <atomic>
+
+typedef struct {
+    std::atomic<int64_t> live{0};
+    std::atomic<int64_t> peak{0};
+    std::atomic<int64_t> charges{0};
+} counter_t;
+
+static counter_t counters[MEM_CATEGORY_COUNT];
+
+static const char *names[MEM_CATEGORY_COUNT] = {
+    "overlay_bitmaps",
+    "overlay_scaled",
+    "overlay_rle",
+    "palettes",
+    "title_info",
+    "keyframe_index",
+    "sound_effects",
+};
+
+void MemStats::add(mem_category_t category, int64_t bytes, int charges) {
+    counter_t &counter = counters[category];
+    counter.charges += charges;
+    int64_t live = counter.live += bytes;
+    int64_t peak = counter.peak;
+    while (live > peak && !counter.peak.compare_exchange_weak(peak, live));
+}
+
+mem_usage_t MemStats::usage(mem_category_t category) {
+    const counter_t &counter = counters[category];
+    return mem_usage_t({
+        .name = names[category],
+        .live = counter.live,
+        .peak = counter.peak,
+        .charges = counter.charges
+    });
+}
+
+std::vector<mem_usage_t> MemStats::snapshot() {
+    std::vector<mem_usage_t> usages;
+    for (int i = 0; i < MEM_CATEGORY_COUNT; i++)
+        usages.push_back(usage((mem_category_t)i));
+    return usages;
+}
+
+int64_t MemStats::total() {
+    int64_t total = 0;
+    for (const counter_t &counter : counters)
+        total += counter.live;
+    return total;
+}
+
+void MemStats::reset_peaks() {
+    for (counter_t &counter : counters)
+        counter.peak = counter.live.load();
+}
+
+void MemStats::log() {
+    for (const mem_usage_t &usage : snapshot()) {
+        Log::write(LOG_LEVEL_INFO, "mem", "%-16s %9.1f KiB live (%lld charges), %9.1f KiB peak",
+            usage.name, usage.live / 1024.0, (long long)usage.charges, usage.peak / 1024.0);
+    }
+}
+
+MemCharge::MemCharge(mem_category_t category, size_t bytes): category(category), size(bytes) {
+    MemStats::add(category, bytes, 1);
+}
+
+MemCharge::MemCharge(MemCharge &&other): category(other.category), size(other.size) {
+    other.owned = false;
+    other.size = 0;
+}
+
+MemCharge::~MemCharge() {
+    if (owned)
+        MemStats::add(category, -(int64_t)size, -1);
+}
+
+void MemCharge::resize(size_t bytes) {
+    if (owned)
+        MemStats::add(category, (int64_t)bytes - (int64_t)size, 0);
+    size = bytes;
+}
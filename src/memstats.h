@@ -0,0 +1,62 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+typedef enum {
+    MEM_OVERLAY_BITMAPS,
+    MEM_OVERLAY_SCALED,
+    MEM_OVERLAY_RLE,
+    MEM_PALETTES,
+    MEM_TITLE_INFO,
+    MEM_KEYFRAME_INDEX,
+    MEM_SOUND_EFFECTS,
+    MEM_CATEGORY_COUNT
+} mem_category_t;
+
+typedef struct {
+    const char *name;
+    int64_t live;
+    // High-water mark since start or the last reset_peaks().
+    int64_t peak;
+    // Charges currently held.
+    int64_t charges;
+} mem_usage_t;
+
+// Process wide accounting of the memory held for disc resources. Counters
+// are atomic, so charges can be taken and released on any thread.
+class MemStats {
+public:
+    static mem_usage_t usage(mem_category_t category);
+    static std::vector<mem_usage_t> snapshot();
+    static int64_t total();
+    static void reset_peaks();
+    static void log();
+
+private:
+    friend class MemCharge;
+    static void add(mem_category_t category, int64_t bytes, int charges);
+};
+
+// Accounts bytes to a category for as long as it lives. Resources shared
+// between owners (decoded overlay images) share one charge.
+class MemCharge {
+public:
+    MemCharge(mem_category_t category, size_t bytes = 0);
+    MemCharge(MemCharge &&other);
+    MemCharge(const MemCharge &) = delete;
+    MemCharge &operator=(const MemCharge &) = delete;
+    ~MemCharge();
+
+    void resize(size_t bytes);
+    size_t bytes() const { return size; }
+
+private:
+    mem_category_t category;
+    size_t size;
+    bool owned = true;
+};
+
+#endif // MEMSTATS_H
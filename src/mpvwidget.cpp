@@ -1,8 +1,17 @@
 ﻿#include "mpvwidget.h"
 #include "mainwindow.h"
+#include "renderthread.h"
+#include "swrenderer.h"
+#include "eventthread.h"
+#include "playlistanalyzer.h"
+#include "discio.h"
+#include "log.h"
 
 #include <map>
-#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 #include <filesystem>
 
 #include <libbluray/overlay.h>
@@ -16,10 +25,16 @@
 #include <QOpenGLTexture>
 #include <QPainter>
 #include <QWindow>
+#include <QThread>
+#include <QElapsedTimer>
 
-static void wakeup(void *ctx) {
-    QMetaObject::invokeMethod((MpvWidget*)ctx, "on_mpv_events", Qt::QueuedConnection);
-}
+// reply_userdata of asynchronous seek commands
+static const uint64_t SEEK_REPLY = 1;
+// Minimum time between two hover selections sent to libbluray.
+static const int HOVER_INTERVAL_MS = 40;
+// Time given to mpv to open the clip of a newly selected angle before the
+// handover, 90 kHz.
+static const uint64_t ANGLE_LEAD = 90000 / 2;
 
 static void *get_proc_address(void *ctx, const char *name) {
     Q_UNUSED(ctx);
@@ -33,37 +48,91 @@ static void _argb_overlay_cb(void *h, const struct bd_argb_overlay_s * const ov)
     (void)h;
 
     if (ov) {
-      printf("ARGB OVERLAY @%ld p%d %d: %d,%d %dx%d\n", (long)ov->pts, ov->plane, ov->cmd, ov->x, ov->y, ov->w, ov->h);
+      Log::write(LOG_LEVEL_DEBUG, "overlay", "ARGB OVERLAY @%ld p%d %d: %d,%d %dx%d", (long)ov->pts, ov->plane, ov->cmd, ov->x, ov->y, ov->w, ov->h);
 
     } else {
-        printf("ARGB OVERLAY CLOSE\n");
+        Log::write(LOG_LEVEL_DEBUG, "overlay", "ARGB OVERLAY CLOSE");
     }
 }
 
-MpvWidget::MpvWidget(QWidget *parent, Qt::WindowFlags f): QOpenGLWidget(parent, f) {
+MpvWidget::MpvWidget(QWidget *parent, Qt::WindowFlags f): QOpenGLWidget(parent, f),
+    seeker([this](double pos, bool exact) { return _dispatch_seek(pos, exact); }),
+    cache([this](int64_t max_bytes, int64_t max_back_bytes, double readahead_secs) {
+        setProperty("demuxer-max-bytes", (qlonglong)max_bytes);
+        setProperty("demuxer-max-back-bytes", (qlonglong)max_back_bytes);
+        setProperty("demuxer-readahead-secs", readahead_secs);
+    }),
+    overlay_cache([this]() {
+        QMetaObject::invokeMethod(this, [this]() { overlay_changed(); }, Qt::QueuedConnection);
+    }) {
     mpv = mpv_create();
     if (!mpv)
         throw std::runtime_error("could not create mpv context");
 
     // mpv_set_option_string(mpv, "terminal", "yes");
     mpv_set_option_string(mpv, "msg-level", "all=v");
+    // mpv messages go to the log ring buffer instead of the terminal.
+    mpv_request_log_messages(mpv, "v");
     mpv_set_option_string(mpv, "vo", "libmpv");
     int flag = 1;
     mpv_set_option(mpv, "orawts", MPV_FORMAT_FLAG, &flag);
+    // Local files get a demuxer cache as well, sized per clip by cache.
+    adaptive_cache = qgetenv("MPV_BD_CACHE") != "off";
+    if (adaptive_cache)
+        mpv_set_option_string(mpv, "cache", "yes");
+    // Open the clip of a new angle while the current one is still playing.
+    mpv_set_option_string(mpv, "prefetch-playlist", "yes");
     if (mpv_initialize(mpv) < 0)
         throw std::runtime_error("could not initialize mpv context");
+    // Streams inside ISO images are read through DiscIO.
+    DiscIO::add_protocol(mpv);
 
     // Request hw decoding, just for testing.
     mpv::qt::set_option_variant(mpv, "hwdec", "auto");
 
     mpv_observe_property(mpv, 0, "duration", MPV_FORMAT_DOUBLE);
     mpv_observe_property(mpv, 0, "time-pos", MPV_FORMAT_DOUBLE);
-    mpv_set_wakeup_callback(mpv, wakeup, this);
+    mpv_observe_property(mpv, 0, "pause", MPV_FORMAT_FLAG);
+    // Video plane size and display aspect, for mapping the pointer to menu
+    // coordinates without querying mpv on every mouse event.
+    mpv_observe_property(mpv, 0, "width", MPV_FORMAT_DOUBLE);
+    mpv_observe_property(mpv, 0, "height", MPV_FORMAT_DOUBLE);
+    mpv_observe_property(mpv, 0, "video-params/aspect", MPV_FORMAT_DOUBLE);
+    if (adaptive_cache) {
+        mpv_observe_property(mpv, 0, "demuxer-cache-state", MPV_FORMAT_NODE);
+        mpv_observe_property(mpv, 0, "paused-for-cache", MPV_FORMAT_FLAG);
+    }
     setFocusPolicy(Qt::StrongFocus);
+    setMouseTracking(true);
+    hover_timer.setSingleShot(true);
+    connect(&hover_timer, &QTimer::timeout, this, &MpvWidget::hover);
+
+    // Property changes reach the GUI at most once per refresh of the screen.
+    event_thread = new EventThread(this, mpv);
+    if (screen() && screen()->refreshRate() > 0)
+        event_thread->set_frame_interval(1.0 / screen()->refreshRate());
+    event_thread->start();
+
+    // Without a usable GPU mpv renders into memory instead, see SwRenderer.
+    // The widget is not shown then; SwVideoView shows the frames.
+    if (software_rendering()) {
+        sw_renderer = new SwRenderer(this, mpv, [this]() { Q_EMIT softwareFrame(); });
+        sw_renderer->start();
+    }
+
+    frame_stats_log = qEnvironmentVariableIsSet("MPV_BD_FRAME_STATS");
+    io_stats_log = qEnvironmentVariableIsSet("MPV_BD_IO_STATS");
+    decode_pool.setMaxThreadCount(std::min(QThread::idealThreadCount(), 4));
+    connect(this, &QOpenGLWidget::frameSwapped, this, &MpvWidget::frame_swapped);
+    connect(&overlay_queue, &OverlayQueue::presented, this, &MpvWidget::overlay_presented);
 }
 
 MpvWidget::~MpvWidget() {
     makeCurrent();
+    delete render_thread;
+    delete sw_renderer;
+    close_disc();
+    delete event_thread;
     if (mpv_gl)
         mpv_render_context_free(mpv_gl);
     mpv_terminate_destroy(mpv);
@@ -81,7 +150,21 @@ QVariant MpvWidget::getProperty(const QString &name) const {
     return mpv::qt::get_property_variant(mpv, name);
 }
 
+bool MpvWidget::software_rendering() {
+    return qgetenv("MPV_BD_RENDER") == "sw";
+}
+
 void MpvWidget::initializeGL() {
+    if (sw_renderer) return;
+
+    // Optional: render from a dedicated thread, see RenderThread.
+    if (qEnvironmentVariableIsSet("MPV_BD_RENDER_THREAD")) {
+        render_thread = new RenderThread(this, mpv);
+        render_thread->resize(size() * devicePixelRatio(), devicePixelRatio());
+        render_thread->start_rendering(context());
+        return;
+    }
+
     mpv_opengl_init_params gl_init_params[1] = {get_proc_address, nullptr};
     mpv_render_param params[]{
         {MPV_RENDER_PARAM_API_TYPE, const_cast<char *>(MPV_RENDER_API_TYPE_OPENGL)},
@@ -95,6 +178,9 @@ void MpvWidget::initializeGL() {
 }
 
 void MpvWidget::paintGL() {
+    if (render_thread)
+        return render_thread->present();
+
     mpv_opengl_fbo mpfbo {
         static_cast<int>(defaultFramebufferObject()), 
         static_cast<int>(width() * devicePixelRatio()), 
@@ -114,99 +200,276 @@ void MpvWidget::paintGL() {
 
     if (!menu_flush) return;
 
-    double rx = width() / getProperty("width").toDouble();
-    double ry = height() / getProperty("height").toDouble();
-
     QPainter p(this);
-    for (auto graphic : graphics) {
-        QRectF target(graphic.x * rx, graphic.y * ry, graphic.w * rx, graphic.h * ry);
+    draw_overlay(p, size());
+}
+
+void MpvWidget::resizeGL(int w, int h) {
+    if (render_thread)
+        render_thread->resize(QSize(w, h) * devicePixelRatio(), devicePixelRatio());
+    _update_video_transform();
+}
+
+// The software backend's view was resized; the widget follows it, so that
+// menu hit testing maps the same coordinates.
+void MpvWidget::resize_software(QSize size, qreal dpr) {
+    resize(size);
+    if (sw_renderer)
+        sw_renderer->resize(size * dpr, dpr);
+    _update_video_transform();
+}
+
+void MpvWidget::present_software(QPainter &p, QRectF target) {
+    if (!sw_renderer) return;
+    sw_renderer->present(p, target);
+    frame_swapped();
+}
+
+// Where mpv shows the video in a target of size logical pixels: scaled to
+// the display aspect, centered, and rounded to device pixels like mpv
+// does. Needs graphics_mutex.
+QRectF MpvWidget::_video_rect(QSizeF size, qreal dpr) const {
+    if (plane_size.isEmpty())
+        return QRectF(QPointF(0, 0), size);
+
+    double aspect = display_aspect > 0 ? display_aspect : plane_size.width() / plane_size.height();
+    int target_w = llround(size.width() * dpr);
+    int target_h = llround(size.height() * dpr);
+    int w = target_w;
+    int h = llround(w / aspect);
+    if (h > target_h) {
+        h = target_h;
+        w = llround(h * aspect);
+    }
+    return QRectF((target_w - w) / 2 / dpr, (target_h - h) / 2 / dpr, w / dpr, h / dpr);
+}
+
+// Paints the flushed disc overlay over the video. Called from paintGL() or
+// from the render thread.
+void MpvWidget::draw_overlay(QPainter &p, QSizeF size) {
+    std::lock_guard<std::mutex> lock(graphics_mutex);
+    if (!menu_flush || plane_size.isEmpty()) return;
+
+    qreal dpr = p.device()->devicePixelRatioF();
+    QRectF video = _video_rect(size, dpr);
+    OverlayCache::scaled_graphics_t scaled = overlay_cache.lookup(graphics, plane_size, video, dpr);
+    if (scaled) {
+        for (const scaled_graphic_t &graphic : *scaled)
+            p.drawImage(QPointF(graphic.pos) / dpr, graphic.image);
+        return;
+    }
+
+    // Scale on the fly until the cache has caught up.
+    double rx = video.width() / plane_size.width();
+    double ry = video.height() / plane_size.height();
+
+    for (auto &graphic : graphics) {
+        QRectF target(video.x() + graphic.x * rx, video.y() + graphic.y * ry, graphic.w * rx, graphic.h * ry);
         p.drawImage(target, graphic.g);
     }
 }
 
+// The overlay for a software frame of size device pixels, prescaled. Null if
+// there is nothing to draw; *pending is set while the cache is rebuilding.
+OverlayCache::scaled_graphics_t MpvWidget::scaled_overlay(QSize size, qreal dpr, bool *pending) {
+    std::lock_guard<std::mutex> lock(graphics_mutex);
+    *pending = false;
+    if (!menu_flush || plane_size.isEmpty()) return nullptr;
+
+    QRectF video = _video_rect(QSizeF(size) / dpr, dpr);
+    OverlayCache::scaled_graphics_t scaled = overlay_cache.lookup(graphics, plane_size, video, dpr);
+    *pending = !scaled;
+    return scaled;
+}
+
+// Caches the mapping from widget coordinates to the video plane that menus
+// are authored in.
+void MpvWidget::_update_video_transform() {
+    std::lock_guard<std::mutex> lock(graphics_mutex);
+    transform_dpr = devicePixelRatioF();
+    if (plane_size.isEmpty()) {
+        widget_to_plane = QTransform();
+        return;
+    }
+    QRectF video = _video_rect(size(), transform_dpr);
+    widget_to_plane = QTransform::fromTranslate(-video.x(), -video.y()) *
+                      QTransform::fromScale(plane_size.width() / video.width(),
+                                            plane_size.height() / video.height());
+}
+
+// Repaint once for an overlay change instead of waiting for a video frame.
+void MpvWidget::overlay_changed() {
+    if (render_thread)
+        render_thread->request_redraw();
+    else if (sw_renderer)
+        sw_renderer->request_redraw();
+    else
+        update();
+}
+
+void MpvWidget::overlay_presented() {
+    {
+        std::lock_guard<std::mutex> lock(graphics_mutex);
+        graphics = overlay_queue.current();
+        menu_flush = !graphics.empty();
+    }
+    overlay_changed();
+}
+
 void MpvWidget::keyPressEvent(QKeyEvent *event) {
     if (bd == NULL) return;
+    // The selection may move away from the button under the pointer.
+    hovered_button = QRect();
 
-    uint64_t sec = getProperty("time-pos").toUInt();
-    BLURAY_CLIP_INFO clip_info = _get_clip_info();
-    uint64_t pts = clip_info.in_time + sec * 45000;
+    uint64_t pts = clock.stream_pts();
 
     switch (event->key()) {
         case Qt::Key_Left:
-            bd_user_input(bd, pts, BD_VK_LEFT);
+            bd_user_input(bd.get(), pts, BD_VK_LEFT);
             break;
         case Qt::Key_Right:
-            bd_user_input(bd, pts, BD_VK_RIGHT);
+            bd_user_input(bd.get(), pts, BD_VK_RIGHT);
             break;
         case Qt::Key_Up:
-            bd_user_input(bd, pts, BD_VK_UP);
+            bd_user_input(bd.get(), pts, BD_VK_UP);
             break;
         case Qt::Key_Down:
-            bd_user_input(bd, pts, BD_VK_DOWN);
+            bd_user_input(bd.get(), pts, BD_VK_DOWN);
             break;
         case Qt::Key_Return:
-            bd_user_input(bd, pts, BD_VK_ENTER);
+            bd_user_input(bd.get(), pts, BD_VK_ENTER);
             if (_wait_idle())
                 _play();
             
             break;
+        case Qt::Key_PageUp:
+            seek_chapter(-1);
+            break;
+        case Qt::Key_PageDown:
+            seek_chapter(1);
+            break;
+        case Qt::Key_A:
+            next_angle();
+            break;
 
         default: ;
     }
 }
 
+// Pointer position in video plane coordinates, recomputing the cached
+// transform if the widget moved to a screen with another pixel ratio.
+QPointF MpvWidget::_map_to_plane(QPointF pos) {
+    if (devicePixelRatioF() != transform_dpr)
+        _update_video_transform();
+    return widget_to_plane.map(pos);
+}
+
+// Topmost interactive graphic of the displayed IG page under point, an
+// empty rect if there is none.
+QRect MpvWidget::_hit_test(QPointF point) const {
+    const std::vector<graphic_t> &page = overlay_queue.plane(BD_OVERLAY_IG);
+    for (auto graphic = page.rbegin(); graphic != page.rend(); ++graphic) {
+        QRect rect(graphic->x, graphic->y, graphic->w, graphic->h);
+        if (rect.contains(point.toPoint()))
+            return rect;
+    }
+    return QRect();
+}
+
+void MpvWidget::_mouse_select(QPointF point) {
+    bd_mouse_select(bd.get(), clock.stream_pts(), point.x(), point.y());
+    since_select.start();
+}
+
+// Selects the button under the pointer once it changes, at most every
+// HOVER_INTERVAL_MS; the latest position is sent when the interval ends.
+void MpvWidget::hover() {
+    if (bd == NULL || !player_info[BD_EVENT_MENU])
+        return;
+
+    QPointF point = _map_to_plane(hover_pos);
+    QRect button = _hit_test(point);
+    if (button.isEmpty() || button == hovered_button)
+        return;
+
+    if (since_select.isValid() && since_select.elapsed() < HOVER_INTERVAL_MS) {
+        if (!hover_timer.isActive())
+            hover_timer.start(HOVER_INTERVAL_MS - since_select.elapsed());
+        return;
+    }
+    hovered_button = button;
+    _mouse_select(point);
+}
+
+void MpvWidget::mouseMoveEvent(QMouseEvent *event) {
+    hover_pos = event->position();
+    hover();
+}
+
 void MpvWidget::mousePressEvent(QMouseEvent *event) {
-    (void)event;
     if (bd == NULL || !player_info[BD_EVENT_MENU])
         return;
-    uint64_t sec = getProperty("time-pos").toUInt();
-    BLURAY_CLIP_INFO clip_info = _get_clip_info();
-    uint64_t pts = clip_info.in_time + sec * 45000;
-    double rx = getProperty("width").toDouble() / width();
-    double ry = getProperty("height").toDouble() / height();
-    QPointF point = event->pos();
-    bd_mouse_select(bd, pts, point.x() * rx, point.y() * ry);
+    QPointF point = _map_to_plane(event->position());
+    hovered_button = _hit_test(point);
+    _mouse_select(point);
 }
 
 void MpvWidget::mouseDoubleClickEvent(QMouseEvent *event) {
     (void)event;
     if (bd == NULL || !player_info[BD_EVENT_MENU])
         return;
-    uint64_t sec = getProperty("time-pos").toUInt();
-    BLURAY_CLIP_INFO clip_info = _get_clip_info();
-    uint64_t pts = clip_info.in_time + sec * 45000;
-    bd_user_input(bd, pts, BD_VK_MOUSE_ACTIVATE);
+    bd_user_input(bd.get(), clock.stream_pts(), BD_VK_MOUSE_ACTIVATE);
     if (_wait_idle())
         _play();
 }
 
+// Queued by the event thread; handles everything it collected since the
+// last call.
 void MpvWidget::on_mpv_events() {
-    // Process all events, until the event queue is empty.
-    while (mpv) {
-        mpv_event *event = mpv_wait_event(mpv, 0);
-        if (event->event_id == MPV_EVENT_NONE)
-            break;
+    for (const queued_event_t &event : event_thread->take())
         handle_mpv_event(event);
-    }
 }
 
-void MpvWidget::handle_mpv_event(mpv_event *event) {
-    switch (event->event_id) {
+void MpvWidget::handle_mpv_event(const queued_event_t &event) {
+    switch (event.event_id) {
         case MPV_EVENT_PROPERTY_CHANGE: {
-            mpv_event_property *prop = (mpv_event_property *)event->data;
-            if (strcmp(prop->name, "time-pos") == 0) {
-                if (prop->format == MPV_FORMAT_DOUBLE) {
-                    double time = *(double *)prop->data;
-                    Q_EMIT positionChanged(time);
+            if (event.name == "time-pos") {
+                if (event.format == MPV_FORMAT_DOUBLE) {
+                    clock.set_position(event.value_double);
+                    Q_EMIT positionChanged(bd != NULL ? BdClock::seconds(clock.title_time()) : event.value_double);
+                    overlay_queue.set_clock(clock.stream_pts());
                 }
-                
-                if (bd != NULL && !player_info[BD_EVENT_TITLE])
+
+                // Outside of titles libbluray only follows playback through
+                // resyncs; one per second of progress is enough.
+                if (bd != NULL && !player_info[BD_EVENT_TITLE] &&
+                    (!synced || std::llabs((int64_t)(clock.title_time() - synced_title_time)) >= (int64_t)BdClock::RATE))
                     update_player_info();
-            } else if (strcmp(prop->name, "duration") == 0) {
-                if (prop->format == MPV_FORMAT_DOUBLE) {
-                    double time = *(double *)prop->data;
-                    Q_EMIT durationChanged(time);
+            } else if (event.name == "duration") {
+                // With a disc open the slider spans the whole title, see _play().
+                if (bd == NULL && event.format == MPV_FORMAT_DOUBLE)
+                    Q_EMIT durationChanged(event.value_double);
+            } else if (event.name == "pause") {
+                if (event.format == MPV_FORMAT_FLAG)
+                    overlay_queue.set_paused(event.value_flag);
+            } else if (event.name == "width" || event.name == "height" || event.name == "video-params/aspect") {
+                double value = event.format == MPV_FORMAT_DOUBLE ? event.value_double : 0;
+                {
+                    std::lock_guard<std::mutex> lock(graphics_mutex);
+                    if (event.name == "width")
+                        plane_size.setWidth(value);
+                    else if (event.name == "height")
+                        plane_size.setHeight(value);
+                    else
+                        display_aspect = value;
                 }
+                _update_video_transform();
+            } else if (event.name == "demuxer-cache-state") {
+                if (event.format == MPV_FORMAT_NODE && bd != NULL)
+                    cache.update(event.value_node.toMap());
+            } else if (event.name == "paused-for-cache") {
+                if (event.format == MPV_FORMAT_FLAG && bd != NULL)
+                    cache.paused_for_cache(event.value_flag);
             }
             break;
         }
@@ -217,15 +480,25 @@ void MpvWidget::handle_mpv_event(mpv_event *event) {
         case MPV_EVENT_PLAYBACK_RESTART: {
             // setMinimumSize(640, 360);
             // setMaximumSize(QWIDGETSIZE_MAX, QWIDGETSIZE_MAX);
-            if (!seek) break;
-            update_player_info();
-            seek = false;
+            if (seek) {
+                update_player_info();
+                seek = false;
+            }
+            seeker.playback_restart();
+            break;
+        }
+        case MPV_EVENT_COMMAND_REPLY: {
+            if (event.reply_userdata == SEEK_REPLY && event.error < 0)
+                seeker.command_failed();
             break;
         }
         case MPV_EVENT_END_FILE: {
-            auto data = (mpv_event_end_file *)event->data;
-            if (data->reason == MPV_END_FILE_REASON_EOF)
-                player_end_file();
+            if (event.reason == MPV_END_FILE_REASON_EOF) {
+                if (angle_handover)
+                    _angle_handover();
+                else
+                    player_end_file();
+            }
             break;
         }
         case MPV_EVENT_FILE_LOADED: {
@@ -234,11 +507,6 @@ void MpvWidget::handle_mpv_event(mpv_event *event) {
             //     ((MainWindow*)parentWidget())->resize(screenGeometry.width(), screenGeometry.height());
             // else setFixedSize(getProperty("width").toInt(), getProperty("height").toInt());
 
-            if (start_time) {
-                setProperty("time-pos", (qulonglong)start_time);
-                start_time = 0;
-            }
-            
             break;
         }
         default: ;
@@ -269,21 +537,92 @@ void MpvWidget::on_update(void *ctx) {
     QMetaObject::invokeMethod((MpvWidget*)ctx, "maybeUpdate");
 }
 
+void MpvWidget::frame_swapped() {
+    frame_stats.record();
+    if (render_thread)
+        render_thread->report_swap();
+
+    if (frame_stats_log && frame_stats.frames() >= 600) {
+        Log::write(LOG_LEVEL_INFO, "stats",
+            "Frame timing (%s): %" PRIu64 " frames, mean %.3f ms, jitter %.3f ms, max %.3f ms",
+            render_thread ? "render thread" : sw_renderer ? "software" : "GUI thread", frame_stats.frames(),
+            frame_stats.mean_ms(), frame_stats.jitter_ms(), frame_stats.max_ms());
+        frame_stats.reset();
+
+        if (sw_renderer) {
+            sw_render_stats_t sw = sw_renderer->stats();
+            Log::write(LOG_LEVEL_INFO, "stats",
+                "Software render: %" PRIu64 " frames (%.1f fps), %" PRIu64 " overlay updates, "
+                "render %.3f ms, blend %.3f ms, %.1f rows blended per update",
+                sw.frames, sw.fps, sw.redraws, sw.mean_render_ms, sw.mean_blend_ms, sw.rows_per_update);
+            sw_renderer->reset_stats();
+        }
+
+        overlay_timing_t timing = overlay_queue.timing();
+        if (timing.presented) {
+            Log::write(LOG_LEVEL_INFO, "stats",
+                "Overlay timing: %" PRIu64 " states, mean %+.3f ms, max early %.3f ms, max late %.3f ms",
+                timing.presented, timing.mean_error_ms, timing.max_early_ms, timing.max_late_ms);
+            overlay_queue.reset_timing();
+        }
+
+        sound_latency_t latency = sound_effects.latency();
+        if (latency.triggered) {
+            Log::write(LOG_LEVEL_INFO, "stats",
+                "Sound effect latency: %" PRIu64 " triggers, mean %.3f ms, max %.3f ms",
+                latency.triggered, latency.mean_ms, latency.max_ms);
+            sound_effects.reset_latency();
+        }
+        MemStats::log();
+
+        event_stats_t events = event_thread->stats();
+        Log::write(LOG_LEVEL_INFO, "stats",
+            "mpv events: %" PRIu64 " received, %" PRIu64 " property changes merged, %" PRIu64 " GUI wakeups",
+            events.received, events.merged, events.posted);
+        event_thread->reset_stats();
+
+        const cache_status_t &status = cache.status();
+        if (status.decisions) {
+            Log::write(LOG_LEVEL_INFO, "stats",
+                "Demuxer cache: readahead %.0f s, max %" PRId64 " MiB, %" PRIu64 " decisions, "
+                "%" PRIu64 " underruns, %" PRIu64 " stalls",
+                status.readahead_secs, status.max_bytes >> 20, status.decisions,
+                status.underruns, status.stalls);
+        }
+
+        overlay_cache_stats_t overlays = overlay_cache.stats();
+        if (overlays.hits || overlays.misses) {
+            Log::write(LOG_LEVEL_INFO, "stats",
+                "Overlay cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " rebuilds (mean %.3f ms), "
+                "%" PRIu64 " objects scaled, %" PRIu64 " reused",
+                overlays.hits, overlays.misses, overlays.rebuilds, overlays.mean_rebuild_ms,
+                overlays.scaled, overlays.reused);
+            overlay_cache.reset_stats();
+        }
+    }
+}
+
 #define PRINT_EV0(e)                                \
   case BD_EVENT_##e:                                \
-      printf(#e "\n");                              \
+      Log::write(LOG_LEVEL_INFO, "bd", #e);         \
       break
-#define PRINT_EV1(e,f)                              \
+#define LOG_EV1(level,e,f)                          \
   case BD_EVENT_##e:                                \
-    printf("%-25s " f "\n", #e ":", ev.param);     \
+    Log::write(level, "bd", "%-25s " f, #e ":", ev.param); \
       break
+#define PRINT_EV1(e,f) LOG_EV1(LOG_LEVEL_INFO, e, f)
+#define ERROR_EV1(e,f) LOG_EV1(LOG_LEVEL_ERROR, e, f)
 
 bool MpvWidget::_wait_idle() {
     BD_EVENT ev;
     bool new_play = false;
 
+    // No navigation events without bd_play().
+    if (main_feature)
+        return false;
+
     do {
-        bd_read_ext(bd, NULL, 0, &ev);
+        read_event(bd.get(), NULL, 0, &ev);
         switch ((bd_event_e)ev.event) {
 
             case BD_EVENT_NONE:
@@ -292,9 +631,9 @@ bool MpvWidget::_wait_idle() {
 
             /* errors */
 
-            PRINT_EV1(ERROR,      "%u");
-            PRINT_EV1(READ_ERROR, "%u");
-            PRINT_EV1(ENCRYPTED,  "%u");
+            ERROR_EV1(ERROR,      "%u");
+            ERROR_EV1(READ_ERROR, "%u");
+            ERROR_EV1(ENCRYPTED,  "%u");
 
             /* current playback position */
 
@@ -329,7 +668,10 @@ bool MpvWidget::_wait_idle() {
 
             PRINT_EV1(STILL_TIME,           "%u");
             PRINT_EV1(STILL,                "%u");
-            PRINT_EV1(SOUND_EFFECT,         "%u");
+            // PRINT_EV1(SOUND_EFFECT,         "%u");
+            case BD_EVENT_SOUND_EFFECT:
+                sound_effects.trigger(ev.param);
+                break;
             PRINT_EV1(IDLE,                 "%u");
             // PRINT_EV1(POPUP,                "%u");
             case BD_EVENT_POPUP:
@@ -368,7 +710,6 @@ bool MpvWidget::_wait_idle() {
             PRINT_EV1(SECONDARY_VIDEO_SIZE,   "%u");
             PRINT_EV1(PIP_PG_TEXTST_STREAM,   "%u");
         }
-        fflush(stdout);
         
         player_info[(bd_event_e)ev.event] = ev.param;
     } while (ev.event != BD_EVENT_NONE && ev.event != BD_EVENT_ERROR);
@@ -376,146 +717,239 @@ bool MpvWidget::_wait_idle() {
     return new_play;
 }
 
-BLURAY_TITLE_INFO MpvWidget::_get_playlist_info() {
-    return *bd_get_playlist_info(bd, 
-        player_info[BD_EVENT_PLAYLIST], player_info[BD_EVENT_ANGLE]);
+// Title infos are parsed once per playlist and angle and kept until the disc
+// is closed. An empty one stands in if libbluray cannot provide it.
+const BLURAY_TITLE_INFO &MpvWidget::_get_playlist_info() {
+    return _get_title_info(player_info[BD_EVENT_PLAYLIST], player_info[BD_EVENT_ANGLE]);
+}
+
+const BLURAY_TITLE_INFO &MpvWidget::_get_title_info(uint32_t playlist, uint32_t angle) {
+    static const BLURAY_TITLE_INFO empty = {};
+
+    uint64_t key = (uint64_t)playlist << 8 | angle;
+    auto found = title_infos.find(key);
+    if (found == title_infos.end()) {
+        title_info_ptr info(bd_get_playlist_info(bd.get(), playlist, angle));
+        if (!info) {
+            Log::write(LOG_LEVEL_WARN, "bd", "No title info for %05u.mpls angle %u", playlist, angle);
+            return empty;
+        }
+        size_t bytes = title_info_bytes(info.get());
+        found = title_infos.emplace(key, cached_title_info_t({
+            .info = std::move(info),
+            .charge = MemCharge(MEM_TITLE_INFO, bytes)
+        })).first;
+    }
+    return *found->second.info;
 }
 
 BLURAY_CLIP_INFO MpvWidget::_get_clip_info() {
-    BLURAY_TITLE_INFO playlist_info = _get_playlist_info();
-    
+    const BLURAY_TITLE_INFO &playlist_info = _get_playlist_info();
+    if (player_info[BD_EVENT_PLAYITEM] >= playlist_info.clip_count)
+        return BLURAY_CLIP_INFO();
+
     return playlist_info.clips[player_info[BD_EVENT_PLAYITEM]];
 }
 
-void MpvWidget::_play() {
-    BLURAY_TITLE_INFO playlist_info = _get_playlist_info();
+// Loads the current play item with mpv limited to its in/out range, starting
+// at start_pts (stream pts) or, if 0, at the chapter libbluray is in. The
+// range is passed with loadfile, so mpv decodes from the start position
+// right away and stops at out_time instead of running to the end of the
+// m2ts.
+void MpvWidget::_play(uint64_t start_pts) {
+    const BLURAY_TITLE_INFO &playlist_info = _get_playlist_info();
+    if (player_info[BD_EVENT_PLAYITEM] >= playlist_info.clip_count)
+        return;
     BLURAY_CLIP_INFO clip_info = _get_clip_info();
+    keyframes.load(bd.get(), player_info[BD_EVENT_PLAYLIST], player_info[BD_EVENT_ANGLE], playlist_info.clip_count);
+    // Clip maps of the other angles, so that a switch needs no parsing.
+    for (uint32_t angle = 0; angle < playlist_info.angle_count; angle++)
+        _get_title_info(player_info[BD_EVENT_PLAYLIST], angle);
+    angle_handover = false;
     
-    if (player_info[BD_EVENT_TITLE] != 0) {
-        uint64_t chapter_start = playlist_info.chapters[player_info[BD_EVENT_CHAPTER] - 1].start;
-        for (uint i = 0; i < player_info[BD_EVENT_PLAYITEM]; i++) {
-            BLURAY_CLIP_INFO clip_info = playlist_info.clips[i];
-            chapter_start -= clip_info.out_time - clip_info.in_time;
-        }
-        start_time = chapter_start / 90000;
-    }
-    QString filepath = dir + "/BDMV/STREAM/" + QString::fromUtf8(clip_info.clip_id) + ".m2ts";
-    command(QStringList() << "loadfile" << filepath);
+    uint32_t chapter = player_info[BD_EVENT_CHAPTER];
+    if (start_pts == 0 && player_info[BD_EVENT_TITLE] != 0 && !main_feature &&
+        chapter >= 1 && chapter <= playlist_info.chapter_count)
+        start_pts = BdClock::title_to_stream(clip_info, playlist_info.chapters[chapter - 1].start);
+    start_pts = std::max(std::min(start_pts, clip_info.out_time), clip_info.in_time);
+    clock.set_clip(clip_info);
+    synced = false;
+    Q_EMIT durationChanged(BdClock::seconds(playlist_info.duration));
+    QString filename = QString::fromUtf8(clip_info.clip_id) + ".m2ts";
+    if (adaptive_cache)
+        cache.set_clip(filename.toStdString(), _clip_rate(player_info[BD_EVENT_PLAYITEM], clip_info));
+    _loadfile(clip_info, start_pts, false);
 }
 
-static void _overlay_cb(void *h, const struct bd_overlay_s * const ov) {
-    MpvWidget *m_mpv = (MpvWidget *)h;
+// Loads the play item's clip from start_pts up to its out_time, replacing
+// the current file or appended as the next one.
+void MpvWidget::_loadfile(const BLURAY_CLIP_INFO &clip_info, uint64_t start_pts, bool append) {
+    QString filename = QString::fromUtf8(clip_info.clip_id) + ".m2ts";
+    QString filepath = disc_io->stream_url("BDMV/STREAM/" + filename);
+
+    // Without rebasing, time-pos and the start/end options are stream pts
+    // in seconds, so the range is exact whatever the m2ts starts with.
+    QString options = QString("rebase-start-time=no,start=%1")
+        .arg(clock.mpv_time_at(start_pts), 0, 'f', 6);
+    if (clip_info.out_time > clip_info.in_time)
+        options += QString(",end=%1").arg(clock.mpv_time_at(clip_info.out_time), 0, 'f', 6);
+    QVariantMap loadfile;
+    loadfile["name"] = "loadfile";
+    loadfile["url"] = filepath;
+    loadfile["flags"] = append ? "append" : "replace";
+    loadfile["options"] = options;
+    command(loadfile);
+}
 
-    if (ov) {
-        // printf("OVERLAY @%ld p%d %d: %d,%d %dx%d\n", (long)ov->pts, ov->plane, ov->cmd, ov->x, ov->y, ov->w, ov->h);
+// Switches to another angle of the current title, keeping the position.
+// The clips of a multi-angle play item share their timestamps and can only
+// change angle at keyframes, so the new angle's clip is appended to mpv's
+// playlist, starting at the first keyframe after a short lead, and the
+// current clip is cut there. mpv then continues with the new clip without
+// a seek or a reload of the title.
+bool MpvWidget::select_angle(uint32_t angle) {
+    if (bd == NULL) return false;
+    const BLURAY_TITLE_INFO &playlist_info = _get_playlist_info();
+    if (angle >= playlist_info.angle_count || angle == player_info[BD_EVENT_ANGLE])
+        return false;
+
+    BLURAY_CLIP_INFO old_clip = _get_clip_info();
+    if (!bd_select_angle(bd.get(), angle)) {
+        Log::write(LOG_LEVEL_WARN, "bd", "Cannot select angle %u", angle);
+        return false;
+    }
+    _wait_idle();
+    player_info[BD_EVENT_ANGLE] = angle;
 
-        if (ov->cmd == BD_OVERLAY_CLEAR || ov->cmd == BD_OVERLAY_CLOSE) {
-            m_mpv->menu_flush = false;
-            return m_mpv->graphics.clear();
-        }
-        if (ov->cmd == BD_OVERLAY_FLUSH)
-            m_mpv->menu_flush = true;
-        if (ov->cmd == BD_OVERLAY_CLEAR)
-            return m_mpv->graphics.clear();
-        if (ov->cmd != BD_OVERLAY_DRAW) return;
+    uint32_t playitem = player_info[BD_EVENT_PLAYITEM];
+    BLURAY_CLIP_INFO clip_info = _get_clip_info();
+    keyframes.load(bd.get(), player_info[BD_EVENT_PLAYLIST], angle, _get_playlist_info().clip_count);
+    // Only the clip of this play item changes; the clock stays valid.
+    if (strcmp(clip_info.clip_id, old_clip.clip_id) == 0) {
+        Log::write(LOG_LEVEL_INFO, "bd", "Angle %u from the next multi-angle play item", angle + 1);
+        return true;
+    }
 
-        int pixels_drawn = 0;
-        int img_idx = 0;
+    uint64_t handover = clock.stream_pts() + ANGLE_LEAD;
+    keyframe_t keyframe;
+    if (keyframes.after(playitem, handover, &keyframe))
+        handover = keyframe.pts;
+    if (handover >= clip_info.out_time) {
+        // The next play item is loaded with the new angle anyway.
+        Log::write(LOG_LEVEL_INFO, "bd", "Angle %u from the next play item", angle + 1);
+        return true;
+    }
 
-        double kr;
-        double kg;
-        double kb;
+    // An earlier handover that is still pending is replaced.
+    if (angle_handover)
+        command(QVariantList() << "playlist-clear");
+    _loadfile(clip_info, handover, true);
+    setProperty("end", QString::number(clock.mpv_time_at(handover), 'f', 6));
+    angle_handover = true;
+    since_angle_select.start();
+    Log::write(LOG_LEVEL_INFO, "bd", "Angle %u: %s.m2ts from %.3f s",
+        angle + 1, clip_info.clip_id, BdClock::seconds(handover));
+    return true;
+}
 
-        double offset_y = 16;
-        double scale_y = 255.0 / 219.0;
-        double scale_uv = 255.0 / 112.0;
+void MpvWidget::next_angle() {
+    uint32_t count = _get_playlist_info().angle_count;
+    if (count > 1)
+        select_angle((player_info[BD_EVENT_ANGLE] + 1) % count);
+}
 
-        QImage *graphic = new QImage(ov->w, ov->h, QImage::Format_Indexed8);
+// The current clip reached the handover point and mpv moved on to the new
+// angle's clip.
+void MpvWidget::_angle_handover() {
+    angle_handover = false;
+    BLURAY_CLIP_INFO clip_info = _get_clip_info();
+    if (adaptive_cache)
+        cache.set_clip(std::string(clip_info.clip_id) + ".m2ts",
+                       _clip_rate(player_info[BD_EVENT_PLAYITEM], clip_info));
+    Log::write(LOG_LEVEL_INFO, "bd", "Angle %u playing after %lld ms",
+        player_info[BD_EVENT_ANGLE] + 1, since_angle_select.elapsed());
+}
 
-        if (ov->h >= 600) {
-            kr = 0.2126;
-            kg = 0.7152;
-            kb = 0.0722;
-        } else {
-            kr = 0.299;
-            kg = 0.587;
-            kb = 0.114;
-        }
+// Average bytes/s of the part of the clip that the play item covers: from
+// the EP map if there is one, otherwise from the clip's packet count.
+double MpvWidget::_clip_rate(uint32_t playitem, const BLURAY_CLIP_INFO &clip_info) const {
+    keyframe_t first;
+    keyframe_t last;
+    if (keyframes.at_or_before(playitem, clip_info.in_time, &first) &&
+        keyframes.at_or_before(playitem, clip_info.out_time, &last) &&
+        last.pts > first.pts && last.spn > first.spn)
+        return (last.spn - first.spn) * 192.0 / ((last.pts - first.pts) / 90000.0);
+
+    double seconds = (clip_info.out_time - clip_info.in_time) / 90000.0;
+    return seconds > 0 ? clip_info.pkt_count * 192.0 / seconds : 0;
+}
 
-        QList<QRgb> palettes;
-        for (int i = 0; i < 256; i++) {
-            const BD_PG_PALETTE_ENTRY palette = ov->palette[i];
-            
-            double sy = scale_y * (palette.Y - offset_y);
-            double scb = scale_uv * (palette.Cb - 128);
-            double scr = scale_uv * (palette.Cr - 128);
+static void _overlay_cb(void *h, const struct bd_overlay_s * const ov) {
+    MpvWidget *m_mpv = (MpvWidget *)h;
 
-            int r = sy                            + scr * (1 - kr);
-            int g = sy - scb * (1 - kb) * kb / kg - scr * (1 - kr) * kr / kg;
-            int b = sy + scb * (1 - kb);
+    if (ov) {
+        // printf("OVERLAY @%ld p%d %d: %d,%d %dx%d\n", (long)ov->pts, ov->plane, ov->cmd, ov->x, ov->y, ov->w, ov->h);
 
-            r = std::max(0, std::min(255, r));
-            g = std::max(0, std::min(255, g));
-            b = std::max(0, std::min(255, b));
+        OverlayPage &pending = m_mpv->pending_pages[ov->plane & 1];
 
-            palettes.append(qRgba(r, g, b, palette.T));
+        if (ov->cmd == BD_OVERLAY_CLOSE) {
+            pending.clear();
+            return m_mpv->overlay_queue.close(ov->plane);
         }
-
-        graphic->setColorTable(palettes);
-
-        int x = 0;
-        int y = 0;
-        
-        while (pixels_drawn < ov->w * ov->h) {
-            const BD_PG_RLE_ELEM img = ov->img[img_idx++];
-
-            for (int i = 0; i < img.len; i++) {
-                graphic->setPixel(x++, y, img.color);
-                if (x == ov->w) {
-                    x = 0;
-                    y++;
-                }
-            }
-
-            pixels_drawn += img.len;
+        if (ov->cmd == BD_OVERLAY_CLEAR) {
+            pending.clear();
+            return m_mpv->overlay_queue.push(overlay_state_t({
+                .pts = ov->pts, .plane = ov->plane, .graphics = {}
+            }));
         }
+        if (ov->cmd == BD_OVERLAY_FLUSH) {
+            return m_mpv->overlay_queue.push(overlay_state_t({
+                .pts = ov->pts, .plane = ov->plane, .graphics = pending.decode(&m_mpv->decode_pool)
+            }));
+        }
+        if (ov->cmd != BD_OVERLAY_DRAW) return;
 
-        m_mpv->graphics.push_back(graphic_t({
-            .x = ov->x, .y = ov->y,
-            .w = ov->w, .h = ov->h,
-            .g = *graphic
-        }));
+        pending.capture(ov);
     } else {
-        printf("OVERLAY CLOSE\n");
+        Log::write(LOG_LEVEL_DEBUG, "overlay", "OVERLAY CLOSE");
+        m_mpv->pending_pages[0].clear();
+        m_mpv->pending_pages[1].clear();
+        m_mpv->overlay_queue.clear();
     }
 }
 
-void MpvWidget::open_disc(QString bd_dir, bool skip_first_play) {
-    printf("Opening %s\n", bd_dir.toLocal8Bit().data());
+void MpvWidget::open_disc(QString bd_dir, bool skip_first_play, bool play_main_feature) {
+    Log::write(LOG_LEVEL_INFO, "bd", "Opening %s", bd_dir.toLocal8Bit().data());
 
-    if (bd != NULL)
-        bd_close(bd);
+    close_disc();
 
-    bd = bd_open(bd_dir.toLocal8Bit().data(), NULL);
-    const BLURAY_DISC_INFO *disc_info = bd_get_disc_info(bd);
-    if (!disc_info->bluray_detected) {
-        std::cout << "Could not open disc." << std::endl;
+    // Folders and ISO images both go through DiscIO, so that images play
+    // without being mounted.
+    disc_io.reset(DiscIO::open(bd_dir));
+    if (disc_io != nullptr)
+        bd.reset(disc_io->open_bluray());
+    const BLURAY_DISC_INFO *disc_info = bd ? bd_get_disc_info(bd.get()) : NULL;
+    if (!disc_info || !disc_info->bluray_detected) {
+        Log::write(LOG_LEVEL_ERROR, "bd", "Could not open disc.");
+        close_disc();
         return;
     }
 
-    dir = bd_dir;
+    bd_get_event(bd.get(), NULL);
+    bd_register_overlay_proc(bd.get(), this, _overlay_cb);
+    bd_register_argb_overlay_proc(bd.get(), this, _argb_overlay_cb, NULL);
+    sound_effects.load(bd.get());
 
-    bd_get_event(bd, NULL);
-    bd_register_overlay_proc(bd, this, _overlay_cb);
-    bd_register_argb_overlay_proc(bd, this, _argb_overlay_cb, NULL);
-
-    bd_play(bd);
-    
     player_info = std::map<bd_event_e, uint32_t>(); 
+    main_feature = play_main_feature;
+    if (main_feature && _play_main_feature())
+        return;
+
+    bd_play(bd.get());
     _wait_idle();
 
     if (disc_info->first_play_supported && skip_first_play)
-        bd_seek(bd, bd_get_title_size(bd) - 1);
+        bd_seek(bd.get(), bd_get_title_size(bd.get()) - 1);
 
     _wait_idle();
     player_end_file();
@@ -523,16 +957,52 @@ void MpvWidget::open_disc(QString bd_dir, bool skip_first_play) {
     _play();
 }
 
+// Releases everything that belongs to the open disc; the memory accounted to
+// it drops back to zero once the graphics still on screen are replaced.
+void MpvWidget::close_disc() {
+    if (bd != NULL || disc_io != nullptr)
+        command(QStringList() << "stop");
+
+    // Closing runs the overlay callback, which clears the pending pages
+    // and the overlay queue.
+    bd.reset();
+    if (disc_io != nullptr && io_stats_log)
+        disc_io->log_stats("libbluray");
+    disc_io.reset();
+
+    seeker.reset();
+    cache.reset();
+    clock.reset();
+    synced = false;
+    angle_handover = false;
+    title_infos.clear();
+    keyframes.clear();
+    sound_effects.unload();
+    pending_pages[0].release();
+    pending_pages[1].release();
+    overlay_cache.clear();
+    overlay_queue.clear();
+    {
+        std::lock_guard<std::mutex> lock(graphics_mutex);
+        graphics.clear();
+        menu_flush = false;
+    }
+    player_info.clear();
+    main_feature = false;
+    hover_timer.stop();
+    hovered_button = QRect();
+}
+
 void MpvWidget::_read_to_eof() {
     BD_EVENT ev;
     int      bytes;
     uint64_t total = 0;
     uint8_t  buf[1];
 
-    bd_seek(bd, bd_get_title_size(bd) - 1);
+    bd_seek(bd.get(), bd_get_title_size(bd.get()) - 1);
 
     do {
-        bytes = bd_read_ext(bd, buf, 1, &ev);
+        bytes = bd_read_ext(bd.get(), buf, 1, &ev);
         total += bytes < 0 ? 0 : bytes;
         switch ((bd_event_e)ev.event) {
             case BD_EVENT_NONE:
@@ -541,9 +1011,9 @@ void MpvWidget::_read_to_eof() {
 
             /* errors */
 
-            PRINT_EV1(ERROR,      "%u");
-            PRINT_EV1(READ_ERROR, "%u");
-            PRINT_EV1(ENCRYPTED,  "%u");
+            ERROR_EV1(ERROR,      "%u");
+            ERROR_EV1(READ_ERROR, "%u");
+            ERROR_EV1(ENCRYPTED,  "%u");
 
             /* current playback position */
 
@@ -587,7 +1057,6 @@ void MpvWidget::_read_to_eof() {
             PRINT_EV1(SECONDARY_VIDEO_SIZE,   "%u");
             PRINT_EV1(PIP_PG_TEXTST_STREAM,   "%u");
         }
-        fflush(stdout);
 
         if (ev.event == BD_EVENT_END_OF_TITLE)
             break;
@@ -595,41 +1064,171 @@ void MpvWidget::_read_to_eof() {
         player_info[(bd_event_e)ev.event] = ev.param;
     } while (bytes >= 0);
 
-    printf("_read_to_eof(): read %" PRIu64 " bytes\n", total);
+    Log::write(LOG_LEVEL_V, "bd", "_read_to_eof(): read %" PRIu64 " bytes", total);
 }
 
+// Moves libbluray to mpv's position, so that its navigation (play item and
+// chapter events, timed UO masks) follows playback.
 void MpvWidget::update_player_info() {
     if (bd == NULL) return;
-    uint64_t sec = getProperty("time-pos").toUInt();
-    BLURAY_CLIP_INFO clip_info = _get_clip_info();
-    bd_seek_time(bd, clip_info.start_time + sec * 45000);
+    synced_title_time = clock.title_time();
+    synced = true;
+    bd_seek_time(bd.get(), synced_title_time);
     _wait_idle();
 }
 
 void MpvWidget::player_end_file() {
+    if (main_feature) {
+        if (player_info[BD_EVENT_PLAYITEM] + 1 < _get_playlist_info().clip_count) {
+            player_info[BD_EVENT_PLAYITEM]++;
+            _play();
+        }
+        return;
+    }
+
     BLURAY_CLIP_INFO clip_info = _get_clip_info();
     uint64_t time = clip_info.start_time + clip_info.out_time - clip_info.in_time;
     if (time == _get_playlist_info().duration) {
         _read_to_eof();
         _wait_idle();
-    } else bd_seek_time(bd, time);
+    } else bd_seek_time(bd.get(), time);
     _wait_idle();
     _play();
 }
 
 void MpvWidget::open_menu() {
-    uint64_t sec = getProperty("time-pos").toUInt();
-    BLURAY_CLIP_INFO clip_info = _get_clip_info();
-    bd_menu_call(bd, clip_info.in_time + sec * 45000);
+    if (main_feature) return;
+    bd_menu_call(bd.get(), clock.stream_pts());
     _wait_idle();
     _play();
 }
 
 void MpvWidget::open_popup() {
-    uint64_t sec = getProperty("time-pos").toUInt();
-    BLURAY_CLIP_INFO clip_info = _get_clip_info();
-    uint64_t pts = clip_info.in_time + sec * 45000;
+    if (main_feature) return;
+    bd_user_input(bd.get(), clock.stream_pts(), BD_VK_POPUP);
+    _wait_idle();
+}
+
+void MpvWidget::seek_title(double pos, bool exact) {
+    seeker.request(pos, exact);
+}
+
+void MpvWidget::seek_chapter(int delta) {
+    if (bd == NULL) return;
+    const BLURAY_TITLE_INFO &playlist_info = _get_playlist_info();
+    if (playlist_info.chapter_count == 0)
+        return;
 
-    bd_user_input(bd, pts, BD_VK_POPUP);
+    // Half a second of slack, so that going back from just after a mark
+    // reaches the previous chapter.
+    uint64_t now = clock.title_time() + BdClock::RATE / 2;
+    int current = 0;
+    for (uint32_t i = 0; i < playlist_info.chapter_count; i++)
+        if (playlist_info.chapters[i].start <= now)
+            current = i;
+
+    int chapter = std::clamp<int>(current + delta, 0, playlist_info.chapter_count - 1);
+    // Marks are authored on keyframes, so an exact seek decodes nothing
+    // before the first frame of the chapter.
+    seeker.request(BdClock::seconds(playlist_info.chapters[chapter].start), true);
+}
+
+bool MpvWidget::_dispatch_seek(double pos, bool exact) {
+    const char *flags = exact ? "absolute+exact" : "absolute+keyframes";
+
+    if (bd == NULL) {
+        mpv::qt::node_builder node(QVariantList() << "seek" << pos << flags);
+        return mpv_command_node_async(mpv, SEEK_REPLY, node.node()) >= 0;
+    }
+
+    const BLURAY_TITLE_INFO &playlist_info = _get_playlist_info();
+    if (playlist_info.clip_count == 0)
+        return false;
+
+    uint64_t target = BdClock::ticks(pos);
+    uint32_t playitem = playlist_info.clip_count - 1;
+    for (uint32_t i = 0; i < playlist_info.clip_count; i++) {
+        BLURAY_CLIP_INFO clip_info = playlist_info.clips[i];
+        if (target < clip_info.start_time + clip_info.out_time - clip_info.in_time) {
+            playitem = i;
+            break;
+        }
+    }
+
+    BLURAY_CLIP_INFO clip_info = playlist_info.clips[playitem];
+    uint64_t clip_duration = clip_info.out_time - clip_info.in_time;
+    uint64_t offset = target > clip_info.start_time ? target - clip_info.start_time : 0;
+    offset = std::min(offset, clip_duration);
+
+    // Keyframe seeks go exactly to the EP map entry at or before the
+    // target: decoding starts right there and libbluray lands on the same
+    // entry.
+    keyframe_t keyframe;
+    if (!exact && keyframes.at_or_before(playitem, clip_info.in_time + offset, &keyframe) &&
+        keyframe.pts >= clip_info.in_time) {
+        offset = keyframe.pts - clip_info.in_time;
+        flags = "absolute+exact";
+    }
+
+    // With an angle handover pending the current clip is cut short; reload
+    // the new angle's clip at the target instead.
+    if (playitem == player_info[BD_EVENT_PLAYITEM] && !angle_handover) {
+        double time = clock.mpv_time_at(clip_info.in_time + offset);
+        mpv::qt::node_builder node(QVariantList() << "seek" << time << flags);
+        return mpv_command_node_async(mpv, SEEK_REPLY, node.node()) >= 0;
+    }
+
+    // The target is in another clip of the title: move libbluray there and
+    // load that clip, starting at the target, instead of clamping to the end
+    // of the current one.
+    uint64_t title_time = clip_info.start_time + offset;
+    bd_seek_time(bd.get(), title_time);
     _wait_idle();
-}
\ No newline at end of file
+    if (main_feature) {
+        // No events without navigation; track the play item and chapter
+        // here, as player_end_file() does.
+        player_info[BD_EVENT_PLAYITEM] = playitem;
+        uint32_t chapter = 1;
+        for (uint32_t i = 0; i < playlist_info.chapter_count; i++)
+            if (playlist_info.chapters[i].start <= title_time)
+                chapter = i + 1;
+        player_info[BD_EVENT_CHAPTER] = chapter;
+    }
+    _play(clip_info.in_time + offset);
+    return true;
+}
+
+// Skips First Play and the menus: picks the main feature from the playlists
+// and plays it directly, without disc navigation.
+bool MpvWidget::_play_main_feature() {
+    QElapsedTimer timer;
+    timer.start();
+
+    std::vector<playlist_candidate_t> candidates = PlaylistAnalyzer::analyze(bd.get());
+    if (candidates.empty() || !bd_select_playlist(bd.get(), candidates[0].playlist)) {
+        Log::write(LOG_LEVEL_WARN, "bd", "No main feature found, using disc navigation");
+        main_feature = false;
+        return false;
+    }
+
+    size_t playlists = 0;
+    for (const playlist_candidate_t &candidate : candidates)
+        playlists += 1 + candidate.duplicates.size();
+
+    const playlist_candidate_t &feature = candidates[0];
+    Log::write(LOG_LEVEL_INFO, "bd", "Main feature: %05u.mpls (%" PRIu64 " s, %u chapters, %zu duplicates), "
+        "%zu of %zu playlists unique, analyzed in %lld ms",
+        feature.playlist, feature.duration / 90000, feature.chapters, feature.duplicates.size(),
+        candidates.size(), playlists, timer.elapsed());
+
+    // Without navigation libbluray sends no events; start from the state it
+    // would report at the beginning of the title.
+    player_info[BD_EVENT_TITLE] = 1;
+    player_info[BD_EVENT_PLAYLIST] = feature.playlist;
+    player_info[BD_EVENT_ANGLE] = 0;
+    player_info[BD_EVENT_PLAYITEM] = 0;
+    player_info[BD_EVENT_CHAPTER] = 1;
+    Q_EMIT menuButton(false);
+    _play();
+    return true;
+}
@@ -7,20 +7,40 @@
 #include <mpv/client.h>
 #include <mpv/render_gl.h>
 #include "qthelper.hpp"
+#include "seekscheduler.h"
+#include "framestats.h"
+#include "overlayqueue.h"
+#include "overlay.h"
+#include "soundeffects.h"
+#include "keyframeindex.h"
+#include "bdresource.h"
+#include "memstats.h"
+#include "eventthread.h"
+#include "cachecontroller.h"
+#include "bdclock.h"
+#include "overlaycache.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
 
 #include <QKeyEvent>
 #include <QMouseEvent>
+#include <QPainter>
+#include <QTransform>
+#include <QElapsedTimer>
+#include <QTimer>
+
+class RenderThread;
+class SwRenderer;
+class DiscIO;
 
-typedef struct {
-    uint16_t x;
-    uint16_t y;
-    uint16_t w;
-    uint16_t h;
-    QImage g;
-} graphic_t;
+// bd_read_ext() signature; lets the benchmarks replace the event source.
+typedef int (*bd_event_source_t)(BLURAY *, unsigned char *, int, BD_EVENT *);
 
 class MpvWidget Q_DECL_FINAL: public QOpenGLWidget {
     Q_OBJECT
+    friend class Bench;
 public:
     MpvWidget(QWidget *parent = 0, Qt::WindowFlags f = (Qt::WindowType)0);
     ~MpvWidget();
@@ -28,46 +48,131 @@ public:
     void setProperty(const QString& name, const QVariant& value);
     QVariant getProperty(const QString& name) const;
     QSize sizeHint() const { return QSize(640, 360);}
-    void open_disc(QString dir, bool skip_first_play);
+    void open_disc(QString dir, bool skip_first_play, bool main_feature = false);
+    // Stops playback and frees every resource of the open disc.
+    void close_disc();
     void player_end_file();
     void update_player_info();
     void open_menu();
     void open_popup();
+    void seek_title(double pos, bool exact);
+    // Jumps delta chapters from the current one, exactly to the mark.
+    void seek_chapter(int delta);
+    // Switches angle at the next keyframe, keeping the position.
+    bool select_angle(uint32_t angle);
+    void next_angle();
+    void draw_overlay(QPainter &p, QSizeF size);
+    OverlayCache::scaled_graphics_t scaled_overlay(QSize size, qreal dpr, bool *pending);
+    // Software rendering (MPV_BD_RENDER=sw), shown by SwVideoView.
+    static bool software_rendering();
+    void resize_software(QSize size, qreal dpr);
+    void present_software(QPainter &p, QRectF target);
+    void overlay_changed();
+    const FrameStats &presentation_stats() const { return frame_stats; }
 
     std::vector<graphic_t> graphics;
     bool menu_flush = false;
+    // Guards graphics and menu_flush, which the render thread reads.
+    std::mutex graphics_mutex;
+    // Planes being drawn, decoded and queued for presentation on
+    // BD_OVERLAY_FLUSH.
+    OverlayPage pending_pages[2];
+    QThreadPool decode_pool;
+    OverlayQueue overlay_queue;
 Q_SIGNALS:
     void durationChanged(int value);
     void positionChanged(int value);
     void menuButton(bool value);
     void popupButton(bool value);
+    // A software frame is ready; emitted on the render thread.
+    void softwareFrame();
 protected:
     void initializeGL() Q_DECL_OVERRIDE;
     void paintGL() Q_DECL_OVERRIDE;
+    void resizeGL(int w, int h) Q_DECL_OVERRIDE;
     void keyPressEvent(QKeyEvent *event) Q_DECL_OVERRIDE;
+    void mouseMoveEvent(QMouseEvent *event) Q_DECL_OVERRIDE;
     void mousePressEvent(QMouseEvent *event) Q_DECL_OVERRIDE;
     void mouseDoubleClickEvent(QMouseEvent *event) Q_DECL_OVERRIDE;
 private Q_SLOTS:
     void on_mpv_events();
     void maybeUpdate();
+    void frame_swapped();
+    void overlay_presented();
+    void hover();
 private:
-    void handle_mpv_event(mpv_event *event);
+    void handle_mpv_event(const queued_event_t &event);
     static void on_update(void *ctx);
     bool _wait_idle();
-    void _play();
+    void _play(uint64_t start_pts = 0);
+    void _loadfile(const BLURAY_CLIP_INFO &clip_info, uint64_t start_pts, bool append);
+    void _angle_handover();
     void _read_to_eof();
     BLURAY_CLIP_INFO _get_clip_info();
-    BLURAY_TITLE_INFO _get_playlist_info();
+    const BLURAY_TITLE_INFO &_get_playlist_info();
+    const BLURAY_TITLE_INFO &_get_title_info(uint32_t playlist, uint32_t angle);
+    bool _dispatch_seek(double pos, bool exact);
+    double _clip_rate(uint32_t playitem, const BLURAY_CLIP_INFO &clip_info) const;
+    QRectF _video_rect(QSizeF size, qreal dpr) const;
+    void _update_video_transform();
+    QPointF _map_to_plane(QPointF pos);
+    QRect _hit_test(QPointF point) const;
+    void _mouse_select(QPointF point);
+    bool _play_main_feature();
 
     mpv_handle *mpv;
-    mpv_render_context *mpv_gl;
+    mpv_render_context *mpv_gl = nullptr;
+    RenderThread *render_thread = nullptr;
+    SwRenderer *sw_renderer = nullptr;
+    EventThread *event_thread = nullptr;
+    FrameStats frame_stats;
+    bool frame_stats_log = false;
+    SoundEffects sound_effects;
 
-    QString dir;
-    BLURAY *bd = NULL;
+    typedef struct {
+        title_info_ptr info;
+        MemCharge charge;
+    } cached_title_info_t;
+
+    // Declared before bd, which reads through it until it is closed.
+    std::unique_ptr<DiscIO> disc_io;
+    bool io_stats_log = false;
+    bd_ptr bd;
+    // By playlist << 8 | angle.
+    std::map<uint64_t, cached_title_info_t> title_infos;
+    bd_event_source_t read_event = bd_read_ext;
     std::map<bd_event_e, uint32_t> player_info;
     bool seek = false;
+    // Playing the detected main feature without disc navigation.
+    bool main_feature = false;
     uint32_t sid = 0;
-    uint64_t start_time = 0;
+    BdClock clock;
+    // Title time libbluray was last moved to by update_player_info().
+    uint64_t synced_title_time = 0;
+    bool synced = false;
+    SeekScheduler seeker;
+    KeyframeIndex keyframes;
+    // The clip of a new angle is queued in mpv and the current one ends at
+    // the handover keyframe.
+    bool angle_handover = false;
+    QElapsedTimer since_angle_select;
+    CacheController cache;
+    bool adaptive_cache = true;
+    // Graphics prescaled to the output; guarded by graphics_mutex like the
+    // graphics it is looked up with.
+    OverlayCache overlay_cache;
+
+    // Video plane (menu coordinates) and display aspect as reported by
+    // mpv; guarded by graphics_mutex, the render thread draws with them.
+    QSizeF plane_size;
+    double display_aspect = 0;
+    // Widget to video plane, including letterboxing.
+    QTransform widget_to_plane;
+    qreal transform_dpr = 1;
+    QPointF hover_pos;
+    QRect hovered_button;
+    QTimer hover_timer;
+    QElapsedTimer since_select;
 };
 
 #endif // PLAYERWINDOW_H
@@ -0,0 +1,161 @@
+#include "overlay.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QList>
+#include <QtConcurrent/QtConcurrentMap>
+
+void overlay_palette(const BD_PG_PALETTE_ENTRY *palette, bool bt709, QRgb *argb) {
+    double kr;
+    double kg;
+    double kb;
+
+    double offset_y = 16;
+    double scale_y = 255.0 / 219.0;
+    double scale_uv = 255.0 / 112.0;
+
+    if (bt709) {
+        kr = 0.2126;
+        kg = 0.7152;
+        kb = 0.0722;
+    } else {
+        kr = 0.299;
+        kg = 0.587;
+        kb = 0.114;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        const BD_PG_PALETTE_ENTRY entry = palette[i];
+
+        double sy = scale_y * (entry.Y - offset_y);
+        double scb = scale_uv * (entry.Cb - 128);
+        double scr = scale_uv * (entry.Cr - 128);
+
+        int r = sy                            + scr * (1 - kr);
+        int g = sy - scb * (1 - kb) * kb / kg - scr * (1 - kr) * kr / kg;
+        int b = sy + scb * (1 - kb);
+
+        r = std::max(0, std::min(255, r));
+        g = std::max(0, std::min(255, g));
+        b = std::max(0, std::min(255, b));
+
+        argb[i] = qRgba(r, g, b, entry.T);
+    }
+}
+
+QImage overlay_decode(const struct bd_overlay_s * const ov) {
+    int pixels_drawn = 0;
+    int img_idx = 0;
+
+    QImage graphic(ov->w, ov->h, QImage::Format_Indexed8);
+
+    QList<QRgb> palettes(256);
+    overlay_palette(ov->palette, ov->h >= 600, palettes.data());
+    graphic.setColorTable(palettes);
+
+    int x = 0;
+    int y = 0;
+
+    while (pixels_drawn < ov->w * ov->h) {
+        const BD_PG_RLE_ELEM img = ov->img[img_idx++];
+
+        for (int i = 0; i < img.len; i++) {
+            graphic.setPixel(x++, y, img.color);
+            if (x == ov->w) {
+                x = 0;
+                y++;
+            }
+        }
+
+        pixels_drawn += img.len;
+    }
+
+    return graphic;
+}
+
+void OverlayPage::capture(const struct bd_overlay_s * const ov) {
+    // Menu pages usually share one palette between all objects.
+    size_t palette = palettes.size();
+    if (palette >= 256 && !memcmp(&palettes[palette - 256], ov->palette, 256 * sizeof(BD_PG_PALETTE_ENTRY)))
+        palette -= 256;
+    else
+        palettes.insert(palettes.end(), ov->palette, ov->palette + 256);
+
+    size_t count = 0;
+    int pixels = 0;
+    while (pixels < ov->w * ov->h)
+        pixels += ov->img[count++].len;
+
+    objects.push_back(object_t({
+        .x = ov->x, .y = ov->y,
+        .w = ov->w, .h = ov->h,
+        .rle = rle.size(),
+        .palette = palette,
+        .image = QImage(),
+        .decoded = false,
+        .charge = nullptr
+    }));
+    rle.insert(rle.end(), ov->img, ov->img + count);
+
+    rle_charge.resize(rle.capacity() * sizeof(BD_PG_RLE_ELEM));
+    palettes_charge.resize(palettes.capacity() * sizeof(BD_PG_PALETTE_ENTRY));
+}
+
+// Keeps the arenas' capacity for the next page.
+void OverlayPage::clear() {
+    rle.clear();
+    palettes.clear();
+    objects.clear();
+}
+
+void OverlayPage::release() {
+    clear();
+    rle.shrink_to_fit();
+    palettes.shrink_to_fit();
+    objects.shrink_to_fit();
+    rle_charge.resize(0);
+    palettes_charge.resize(0);
+}
+
+std::vector<graphic_t> OverlayPage::decode(QThreadPool *pool) {
+    std::vector<object_t *> todo;
+    for (object_t &object : objects) {
+        if (!object.decoded)
+            todo.push_back(&object);
+    }
+
+    if (todo.size() == 1)
+        decode_object(*todo[0]);
+    else if (!todo.empty())
+        QtConcurrent::blockingMap(pool, todo, [this](object_t *object) { decode_object(*object); });
+
+    std::vector<graphic_t> graphics;
+    graphics.reserve(objects.size());
+    for (const object_t &object : objects) {
+        graphics.push_back(graphic_t({
+            .x = object.x, .y = object.y,
+            .w = object.w, .h = object.h,
+            .g = object.image,
+            .charge = object.charge
+        }));
+    }
+    return graphics;
+}
+
+void OverlayPage::decode_object(object_t &object) const {
+    bd_overlay_s ov;
+    memset(&ov, 0, sizeof(ov));
+    ov.cmd = BD_OVERLAY_DRAW;
+    ov.x = object.x;
+    ov.y = object.y;
+    ov.w = object.w;
+    ov.h = object.h;
+    ov.palette = &palettes[object.palette];
+    ov.img = &rle[object.rle];
+
+    object.image = overlay_decode(&ov);
+    object.charge = std::make_shared<const MemCharge>(MEM_OVERLAY_BITMAPS,
+        object.image.sizeInBytes() + object.image.colorCount() * sizeof(QRgb));
+    object.decoded = true;
+}
@@ -0,0 +1,61 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <libbluray/overlay.h>
+
+#include <memory>
+#include <vector>
+
+#include <QImage>
+#include <QRgb>
+#include <QThreadPool>
+
+#include "overlayqueue.h"
+
+// Converts a 256-entry YCbCr palette to ARGB, using BT.709 coefficients for
+// HD graphics and BT.601 otherwise.
+void overlay_palette(const BD_PG_PALETTE_ENTRY *palette, bool bt709, QRgb *argb);
+
+// Expands the RLE bitmap of a BD_OVERLAY_DRAW into an indexed image carrying
+// the converted palette.
+QImage overlay_decode(const struct bd_overlay_s * const ov);
+
+// Objects of one plane drawn since the last BD_OVERLAY_CLEAR. A DRAW only
+// copies the RLE runs and palette into arenas owned by the page (libbluray's
+// buffers are only valid during the callback); decoding is deferred until the
+// page is flushed and then runs for all new objects in parallel.
+class OverlayPage {
+public:
+    void capture(const struct bd_overlay_s * const ov);
+    void clear();
+    // Like clear(), but also frees the arenas.
+    void release();
+    bool empty() const { return objects.empty(); }
+
+    // Decodes the objects captured since the last call and returns the whole
+    // page. Blocks until all of them are done.
+    std::vector<graphic_t> decode(QThreadPool *pool);
+
+private:
+    typedef struct {
+        uint16_t x;
+        uint16_t y;
+        uint16_t w;
+        uint16_t h;
+        size_t rle;
+        size_t palette;
+        QImage image;
+        bool decoded;
+        std::shared_ptr<const MemCharge> charge;
+    } object_t;
+
+    void decode_object(object_t &object) const;
+
+    std::vector<BD_PG_RLE_ELEM> rle;
+    std::vector<BD_PG_PALETTE_ENTRY> palettes;
+    std::vector<object_t> objects;
+    MemCharge rle_charge{MEM_OVERLAY_RLE};
+    MemCharge palettes_charge{MEM_PALETTES};
+};
+
+#endif // OVERLAY_H
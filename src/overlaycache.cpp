@@ -0,0 +1,178 @@
+#include "overlaycache.h"
+
+#include <cmath>
+#include <tuple>
+
+#include <QElapsedTimer>
+
+OverlayCache::OverlayCache(std::function<void()> ready): ready(ready) {
+    // Rebuilds supersede each other; one at a time is enough.
+    pool.setMaxThreadCount(1);
+}
+
+OverlayCache::~OverlayCache() {
+    clear();
+}
+
+// Object edges are rounded separately, so that adjacent objects stay
+// adjacent after scaling.
+std::vector<OverlayCache::object_key_t> OverlayCache::make_key(const std::vector<graphic_t> &graphics,
+                                                               QSizeF plane_size, QRectF video, qreal dpr) {
+    double vx = video.x() * dpr;
+    double vy = video.y() * dpr;
+    double rx = video.width() * dpr / plane_size.width();
+    double ry = video.height() * dpr / plane_size.height();
+
+    std::vector<object_key_t> key;
+    key.reserve(graphics.size());
+    for (const graphic_t &graphic : graphics) {
+        int left = llround(vx + graphic.x * rx);
+        int top = llround(vy + graphic.y * ry);
+        int right = llround(vx + (graphic.x + graphic.w) * rx);
+        int bottom = llround(vy + (graphic.y + graphic.h) * ry);
+        key.push_back(object_key_t({
+            .image = graphic.g.cacheKey(),
+            .target = QRect(left, top, right - left, bottom - top)
+        }));
+    }
+    return key;
+}
+
+bool OverlayCache::same(const std::vector<object_key_t> &a, const std::vector<object_key_t> &b) {
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].image != b[i].image || a[i].target != b[i].target)
+            return false;
+    }
+    return true;
+}
+
+OverlayCache::scaled_graphics_t OverlayCache::lookup(const std::vector<graphic_t> &graphics, QSizeF plane_size,
+                                                     QRectF video, qreal dpr) {
+    std::vector<object_key_t> key = make_key(graphics, plane_size, video, dpr);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (built.graphics && built.dpr == dpr && same(built.key, key)) {
+        hit_count++;
+        return built.graphics;
+    }
+    miss_count++;
+    if (pending_valid && pending.dpr == dpr && same(pending.key, key))
+        return nullptr;
+
+    pending = build_t({ .key = key, .dpr = dpr, .graphics = nullptr });
+    pending_valid = true;
+    uint64_t current = ++generation;
+    std::vector<QImage> images;
+    images.reserve(graphics.size());
+    for (const graphic_t &graphic : graphics)
+        images.push_back(graphic.g);
+    pool.start([this, current, key, images, dpr]() { rebuild(current, key, images, dpr); });
+    return nullptr;
+}
+
+void OverlayCache::rebuild(uint64_t current, std::vector<object_key_t> key, std::vector<QImage> images, qreal dpr) {
+    QElapsedTimer timer;
+    timer.start();
+
+    scaled_graphics_t previous;
+    std::vector<int64_t> previous_images;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (current != generation)
+            return;
+        previous = built.graphics;
+        previous_images = built_images;
+    }
+
+    // Objects of the last build, by image and size. A highlighted button
+    // usually changes one object of a page.
+    std::map<std::tuple<int64_t, int, int>, QImage> reusable;
+    if (previous) {
+        for (size_t i = 0; i < previous->size() && i < previous_images.size(); i++) {
+            const QImage &image = (*previous)[i].image;
+            reusable[std::make_tuple(previous_images[i], image.width(), image.height())] = image;
+        }
+    }
+
+    auto graphics = std::make_shared<std::vector<scaled_graphic_t>>();
+    std::vector<int64_t> images_used;
+    graphics->reserve(key.size());
+    size_t bytes = 0;
+    uint64_t scaled = 0;
+    uint64_t reused = 0;
+    for (size_t i = 0; i < key.size(); i++) {
+        const QRect &target = key[i].target;
+        if (target.isEmpty() || images[i].isNull())
+            continue;
+
+        QImage image;
+        auto found = reusable.find(std::make_tuple(key[i].image, target.width(), target.height()));
+        if (found != reusable.end()) {
+            image = found->second;
+            reused++;
+        } else {
+            image = images[i].convertToFormat(QImage::Format_ARGB32_Premultiplied);
+            if (image.size() != target.size())
+                image = image.scaled(target.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            scaled++;
+        }
+        image.setDevicePixelRatio(dpr);
+        bytes += image.sizeInBytes();
+        images_used.push_back(key[i].image);
+        graphics->push_back(scaled_graphic_t({ .pos = target.topLeft(), .image = image }));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (current != generation)
+            return;
+        built = build_t({ .key = key, .dpr = dpr, .graphics = graphics });
+        built_images = images_used;
+        pending_valid = false;
+        charge.resize(bytes);
+        rebuild_count++;
+        scaled_count += scaled;
+        reused_count += reused;
+        rebuild_ms += timer.nsecsElapsed() / 1e6;
+    }
+    ready();
+}
+
+void OverlayCache::clear() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+        pending_valid = false;
+    }
+    pool.clear();
+    pool.waitForDone();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    built = build_t();
+    built_images.clear();
+    charge.resize(0);
+}
+
+overlay_cache_stats_t OverlayCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return overlay_cache_stats_t({
+        .hits = hit_count,
+        .misses = miss_count,
+        .rebuilds = rebuild_count,
+        .scaled = scaled_count,
+        .reused = reused_count,
+        .mean_rebuild_ms = rebuild_count ? rebuild_ms / rebuild_count : 0
+    });
+}
+
+void OverlayCache::reset_stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    hit_count = 0;
+    miss_count = 0;
+    rebuild_count = 0;
+    scaled_count = 0;
+    reused_count = 0;
+    rebuild_ms = 0;
+}
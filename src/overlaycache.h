@@ -0,0 +1,100 @@
+#ifndef OVERLAYCACHE_H
+#define OVERLAYCACHE_H
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include <QRect>
+#include <QImage>
+#include <QThreadPool>
+
+#include "overlayqueue.h"
+#include "memstats.h"
+
+typedef struct {
+    // Top left corner in device pixels of the paint device.
+    QPoint pos;
+    // Premultiplied ARGB at output resolution, carrying the device pixel
+    // ratio, so it is drawn 1:1.
+    QImage image;
+} scaled_graphic_t;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t rebuilds;
+    // Objects converted and scaled, and reused from the previous build.
+    uint64_t scaled;
+    uint64_t reused;
+    double mean_rebuild_ms;
+} overlay_cache_stats_t;
+
+// Keeps the presented overlay graphics converted to premultiplied ARGB and
+// scaled to the video rectangle at device resolution, so that frames blit
+// them 1:1 instead of converting and scaling the indexed images every time.
+// When the graphics, the video rectangle or the device pixel ratio change,
+// the cache is rebuilt once on a worker thread, reusing objects whose image
+// and size did not change; until then lookup() misses and the caller draws
+// the graphics unscaled. Thread safe.
+class OverlayCache {
+public:
+    typedef std::shared_ptr<const std::vector<scaled_graphic_t>> scaled_graphics_t;
+
+    // ready is called on the worker thread when a rebuild is done.
+    explicit OverlayCache(std::function<void()> ready);
+    ~OverlayCache();
+
+    // The scaled graphics for graphics on a plane of plane_size shown in
+    // video (logical pixels) at dpr, or null if they are being rebuilt.
+    scaled_graphics_t lookup(const std::vector<graphic_t> &graphics, QSizeF plane_size,
+                             QRectF video, qreal dpr);
+    // Waits for a running rebuild and drops everything.
+    void clear();
+
+    overlay_cache_stats_t stats() const;
+    void reset_stats();
+
+private:
+    // One object: its image and where it goes, in device pixels.
+    typedef struct {
+        int64_t image;
+        QRect target;
+    } object_key_t;
+
+    typedef struct {
+        std::vector<object_key_t> key;
+        qreal dpr;
+        scaled_graphics_t graphics;
+    } build_t;
+
+    static std::vector<object_key_t> make_key(const std::vector<graphic_t> &graphics, QSizeF plane_size,
+                                              QRectF video, qreal dpr);
+    static bool same(const std::vector<object_key_t> &a, const std::vector<object_key_t> &b);
+    void rebuild(uint64_t current, std::vector<object_key_t> key, std::vector<QImage> images, qreal dpr);
+
+    std::function<void()> ready;
+    QThreadPool pool;
+    mutable std::mutex mutex;
+    build_t built = {};
+    // Image keys of built.graphics.
+    std::vector<int64_t> built_images;
+    // Key of the rebuild in flight, if pending_valid.
+    build_t pending = {};
+    bool pending_valid = false;
+    // Incremented for every rebuild started; older ones are discarded.
+    uint64_t generation = 0;
+    MemCharge charge{MEM_OVERLAY_SCALED};
+
+    uint64_t hit_count = 0;
+    uint64_t miss_count = 0;
+    uint64_t rebuild_count = 0;
+    uint64_t scaled_count = 0;
+    uint64_t reused_count = 0;
+    double rebuild_ms = 0;
+};
+
+#endif // OVERLAYCACHE_H
@@ -0,0 +1,125 @@
+#include "overlayqueue.h"
+
+#include <algorithm>
+
+// MPEG-2 TS timestamps are 33 bits wide.
+static const int64_t PTS_MASK = (1LL << 33) - 1;
+// States further ahead than this are assumed to be from another timeline
+// (e.g. after a discontinuity) and are presented immediately.
+static const int64_t MAX_LEAD = 10 * 90000;
+
+OverlayQueue::OverlayQueue(QObject *parent): QObject(parent) {
+    timer.setSingleShot(true);
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, &QTimer::timeout, this, &OverlayQueue::release);
+}
+
+void OverlayQueue::push(overlay_state_t state) {
+    queue.push_back(std::move(state));
+    release();
+}
+
+void OverlayQueue::close(uint8_t plane) {
+    queue.erase(std::remove_if(queue.begin(), queue.end(),
+        [plane](const overlay_state_t &state) { return state.plane == plane; }), queue.end());
+    displayed[plane & 1].clear();
+    Q_EMIT presented();
+    schedule();
+}
+
+void OverlayQueue::clear() {
+    queue.clear();
+    displayed[0].clear();
+    displayed[1].clear();
+    awaiting_frame.clear();
+    timer.stop();
+    Q_EMIT presented();
+}
+
+void OverlayQueue::set_clock(int64_t pts) {
+    clock_pts = pts & PTS_MASK;
+    clock_timer.restart();
+
+    for (int64_t released : awaiting_frame) {
+        double error = (clock_pts - released) / 90.0;
+        timing_count++;
+        timing_sum += error;
+        timing_early = std::max(timing_early, -error);
+        timing_late = std::max(timing_late, error);
+    }
+    awaiting_frame.clear();
+
+    release();
+}
+
+void OverlayQueue::set_paused(bool value) {
+    if (!value && paused)
+        clock_timer.restart();
+    paused = value;
+    release();
+}
+
+std::vector<graphic_t> OverlayQueue::current() const {
+    std::vector<graphic_t> graphics = displayed[0];
+    graphics.insert(graphics.end(), displayed[1].begin(), displayed[1].end());
+    return graphics;
+}
+
+overlay_timing_t OverlayQueue::timing() const {
+    return overlay_timing_t({
+        .presented = timing_count,
+        .mean_error_ms = timing_count ? timing_sum / timing_count : 0,
+        .max_early_ms = timing_early,
+        .max_late_ms = timing_late
+    });
+}
+
+void OverlayQueue::reset_timing() {
+    timing_count = 0;
+    timing_sum = 0;
+    timing_early = 0;
+    timing_late = 0;
+}
+
+// Video clock extrapolated from the last reported frame position.
+int64_t OverlayQueue::clock() const {
+    if (clock_pts < 0 || paused)
+        return clock_pts;
+    return clock_pts + clock_timer.nsecsElapsed() * 9 / 100000;
+}
+
+bool OverlayQueue::due(const overlay_state_t &state, int64_t now) const {
+    // Without a running clock there is nothing to synchronize to.
+    if (paused || now < 0 || state.pts <= 0)
+        return true;
+    int64_t pts = state.pts & PTS_MASK;
+    return pts <= now || pts - now > MAX_LEAD;
+}
+
+void OverlayQueue::release() {
+    int64_t now = clock();
+    bool released = false;
+
+    while (!queue.empty() && due(queue.front(), now)) {
+        overlay_state_t &state = queue.front();
+        displayed[state.plane & 1] = std::move(state.graphics);
+        if (!paused && now >= 0 && state.pts > 0)
+            awaiting_frame.push_back(state.pts & PTS_MASK);
+        queue.pop_front();
+        released = true;
+    }
+
+    if (released)
+        Q_EMIT presented();
+    schedule();
+}
+
+void OverlayQueue::schedule() {
+    if (queue.empty() || paused || clock_pts < 0) {
+        timer.stop();
+        return;
+    }
+
+    int64_t delay = ((queue.front().pts & PTS_MASK) - clock()) / 90;
+    timer.start(std::clamp<int64_t>(delay, 0, 1000));
+}
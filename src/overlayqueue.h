@@ -0,0 +1,89 @@
+#ifndef OVERLAYQUEUE_H
+#define OVERLAYQUEUE_H
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include <QObject>
+#include <QImage>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "memstats.h"
+
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+    uint16_t w;
+    uint16_t h;
+    QImage g;
+    // Accounts g while any copy of the graphic is alive.
+    std::shared_ptr<const MemCharge> charge;
+} graphic_t;
+
+// A composed overlay plane (PG or IG) as of a BD_OVERLAY_FLUSH or
+// BD_OVERLAY_CLEAR, tagged with its 90 kHz presentation time.
+typedef struct {
+    int64_t pts;
+    uint8_t plane;
+    std::vector<graphic_t> graphics;
+} overlay_state_t;
+
+// Early/late presentation of released states, measured against the pts of
+// the first video frame reported after each release.
+typedef struct {
+    uint64_t presented;
+    double mean_error_ms;
+    double max_early_ms;
+    double max_late_ms;
+} overlay_timing_t;
+
+// Holds composed overlay states until the video clock reaches their pts.
+// The clock is fed from mpv's playback position and extrapolated between
+// updates, so a state is released by a single timer instead of re-rendering
+// until it is due. All methods must be called from the GUI thread.
+class OverlayQueue : public QObject {
+    Q_OBJECT
+public:
+    explicit OverlayQueue(QObject *parent = 0);
+
+    void push(overlay_state_t state);
+    void close(uint8_t plane);
+    void clear();
+    void set_clock(int64_t pts);
+    void set_paused(bool paused);
+
+    // Currently presented graphics, PG below IG.
+    std::vector<graphic_t> current() const;
+    // Currently presented graphics of one plane.
+    const std::vector<graphic_t> &plane(uint8_t plane) const { return displayed[plane & 1]; }
+    overlay_timing_t timing() const;
+    void reset_timing();
+Q_SIGNALS:
+    void presented();
+private Q_SLOTS:
+    void release();
+private:
+    int64_t clock() const;
+    bool due(const overlay_state_t &state, int64_t now) const;
+    void schedule();
+
+    std::deque<overlay_state_t> queue;
+    std::vector<graphic_t> displayed[2];
+    QTimer timer;
+
+    int64_t clock_pts = -1;
+    QElapsedTimer clock_timer;
+    bool paused = false;
+
+    // pts of states released since the last clock update
+    std::vector<int64_t> awaiting_frame;
+    uint64_t timing_count = 0;
+    double timing_sum = 0;
+    double timing_early = 0;
+    double timing_late = 0;
+};
+
+#endif // OVERLAYQUEUE_H
@@ -0,0 +1,197 @@
+#include "playlistanalyzer.h"
+#include "bdresource.h"
+
+#include <map>
+#include <set>
+#include <tuple>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <algorithm>
+
+#include <libbluray/filesystem.h>
+
+#include <QtConcurrent/QtConcurrentMap>
+
+// Candidates shorter than this share of the longest playlist are never
+// considered the main feature.
+static const double MIN_FEATURE_SHARE = 0.5;
+
+static uint16_t read16(const uint8_t *p) {
+    return p[0] << 8 | p[1];
+}
+
+static uint32_t read32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static void fnv1a(uint64_t *hash, const void *data, size_t size) {
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++) {
+        *hash ^= p[i];
+        *hash *= 0x100000001b3ULL;
+    }
+}
+
+bool PlaylistAnalyzer::parse_mpls(const uint8_t *data, size_t size, mpls_t *mpls) {
+    if (size < 20 || memcmp(data, "MPLS", 4))
+        return false;
+
+    uint32_t list_start = read32(data + 8);
+    uint32_t mark_start = read32(data + 12);
+    if (list_start + 10 > size || mark_start + 6 > size)
+        return false;
+
+    mpls->items.clear();
+    uint16_t item_count = read16(data + list_start + 6);
+    size_t pos = list_start + 10;
+    for (uint16_t i = 0; i < item_count; i++) {
+        if (pos + 22 > size)
+            return false;
+        const uint8_t *item = data + pos;
+
+        mpls_item_t parsed;
+        memcpy(parsed.clip_id, item + 2, 5);
+        parsed.clip_id[5] = '\0';
+        parsed.in_time = read32(item + 14);
+        parsed.out_time = read32(item + 18);
+        mpls->items.push_back(parsed);
+
+        pos += 2 + read16(item);
+    }
+
+    // Entry marks are the chapters.
+    mpls->chapters = 0;
+    uint16_t mark_count = read16(data + mark_start + 4);
+    for (uint16_t i = 0; i < mark_count; i++) {
+        size_t mark = mark_start + 6 + i * 14;
+        if (mark + 14 > size)
+            return false;
+        if (data[mark + 1] == 1)
+            mpls->chapters++;
+    }
+    return true;
+}
+
+static playlist_candidate_t evaluate(uint32_t playlist, const mpls_t &mpls) {
+    playlist_candidate_t candidate = {};
+    candidate.playlist = playlist;
+    candidate.chapters = mpls.chapters;
+    candidate.clips = mpls.items.size();
+    candidate.fingerprint = 0xcbf29ce484222325ULL;
+
+    std::set<std::tuple<int, uint32_t, uint32_t>> seen;
+    uint64_t unique = 0;
+    for (size_t i = 0; i < mpls.items.size(); i++) {
+        const mpls_item_t &item = mpls.items[i];
+        uint64_t length = item.out_time > item.in_time ? item.out_time - item.in_time : 0;
+        candidate.duration += length * 2;
+
+        fnv1a(&candidate.fingerprint, item.clip_id, 5);
+        fnv1a(&candidate.fingerprint, &item.in_time, sizeof(item.in_time));
+        fnv1a(&candidate.fingerprint, &item.out_time, sizeof(item.out_time));
+
+        int clip = atoi(item.clip_id);
+        if (seen.insert({clip, item.in_time, item.out_time}).second)
+            unique += length * 2;
+
+        // Obfuscated playlists shuffle the segments of the real one; the
+        // authored order almost always runs forward through the clips.
+        if (i > 0) {
+            const mpls_item_t &prev = mpls.items[i - 1];
+            int prev_clip = atoi(prev.clip_id);
+            if (clip < prev_clip || (clip == prev_clip && item.in_time < prev.out_time))
+                candidate.order_breaks++;
+        }
+    }
+    candidate.coverage = candidate.duration ? (double)unique / candidate.duration : 0;
+    return candidate;
+}
+
+std::vector<playlist_candidate_t> PlaylistAnalyzer::analyze(BLURAY *bd) {
+    typedef struct {
+        uint32_t playlist;
+        bd_buffer_ptr data;
+        int64_t size;
+        bool ok;
+        mpls_t mpls;
+    } file_t;
+
+    // Reading goes through libbluray so that ISO images work too; parsing
+    // is independent per file and runs on the global thread pool.
+    std::vector<file_t> files;
+    BD_DIR_H *dir = bd_open_dir(bd, "BDMV/PLAYLIST");
+    if (dir == NULL)
+        return {};
+
+    BD_DIRENT entry;
+    while (dir->read(dir, &entry) == 0) {
+        size_t len = strlen(entry.d_name);
+        if (len != 10 || strcasecmp(entry.d_name + 5, ".mpls"))
+            continue;
+
+        file_t file = {};
+        file.playlist = atoi(entry.d_name);
+        std::string path = std::string("BDMV/PLAYLIST/") + entry.d_name;
+        void *data = NULL;
+        if (bd_read_file(bd, path.c_str(), &data, &file.size)) {
+            file.data.reset(data);
+            files.push_back(std::move(file));
+        }
+    }
+    dir->close(dir);
+
+    QtConcurrent::blockingMap(files, [](file_t &file) {
+        file.ok = parse_mpls((const uint8_t *)file.data.get(), file.size, &file.mpls);
+        file.data.reset();
+    });
+
+    // Collapse identical playlists into the lowest numbered one.
+    std::sort(files.begin(), files.end(), [](const file_t &a, const file_t &b) {
+        return a.playlist < b.playlist;
+    });
+    std::vector<playlist_candidate_t> candidates;
+    std::map<uint64_t, size_t> by_fingerprint;
+    uint64_t longest = 0;
+    for (const file_t &file : files) {
+        if (!file.ok || file.mpls.items.empty())
+            continue;
+
+        playlist_candidate_t candidate = evaluate(file.playlist, file.mpls);
+        auto found = by_fingerprint.find(candidate.fingerprint);
+        if (found != by_fingerprint.end()) {
+            candidates[found->second].duplicates.push_back(candidate.playlist);
+            continue;
+        }
+        by_fingerprint[candidate.fingerprint] = candidates.size();
+        longest = std::max(longest, candidate.duration);
+        candidates.push_back(candidate);
+    }
+
+    // Long playlists first, then by how "authored" they look.
+    uint64_t threshold = longest * MIN_FEATURE_SHARE;
+    std::sort(candidates.begin(), candidates.end(),
+        [threshold](const playlist_candidate_t &a, const playlist_candidate_t &b) {
+            bool a_long = a.duration >= threshold;
+            bool b_long = b.duration >= threshold;
+            if (a_long != b_long)
+                return a_long;
+            if (!a_long)
+                return a.duration > b.duration;
+
+            int a_coverage = a.coverage * 100;
+            int b_coverage = b.coverage * 100;
+            if (a_coverage != b_coverage)
+                return a_coverage > b_coverage;
+            if (a.order_breaks != b.order_breaks)
+                return a.order_breaks < b.order_breaks;
+            if (a.chapters != b.chapters)
+                return a.chapters > b.chapters;
+            if (a.duration != b.duration)
+                return a.duration > b.duration;
+            return a.playlist < b.playlist;
+        });
+
+    return candidates;
+}
@@ -0,0 +1,45 @@
+#ifndef PLAYLISTANALYZER_H
+#define PLAYLISTANALYZER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <libbluray/bluray.h>
+
+typedef struct {
+    char clip_id[6];
+    uint32_t in_time;  // 45 kHz
+    uint32_t out_time; // 45 kHz
+} mpls_item_t;
+
+typedef struct {
+    std::vector<mpls_item_t> items;
+    uint32_t chapters;
+} mpls_t;
+
+typedef struct {
+    uint32_t playlist;
+    uint64_t duration; // 90 kHz
+    uint32_t chapters;
+    uint32_t clips;
+    // Share of the duration spent in segments that are not repeated.
+    double coverage;
+    // Places where the clip sequence steps backwards.
+    uint32_t order_breaks;
+    uint64_t fingerprint;
+    // Playlists with the same clip sequence and in/out times.
+    std::vector<uint32_t> duplicates;
+} playlist_candidate_t;
+
+// Finds the main feature without opening every title: reads all MPLS files
+// once through libbluray, parses them in parallel, collapses playlists with
+// identical clip sequences and ranks the rest.
+class PlaylistAnalyzer {
+public:
+    // Ranked best first; duplicates are folded into their first playlist.
+    static std::vector<playlist_candidate_t> analyze(BLURAY *bd);
+    static bool parse_mpls(const uint8_t *data, size_t size, mpls_t *mpls);
+};
+
+#endif // PLAYLISTANALYZER_H
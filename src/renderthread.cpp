@@ -0,0 +1,200 @@
+#include "renderthread.h"
+#include "mpvwidget.h"
+#include "log.h"
+
+#include <stdexcept>
+#include <QOpenGLFunctions>
+#include <QOpenGLPaintDevice>
+#include <QPainter>
+
+static void *get_proc_address(void *ctx, const char *name) {
+    Q_UNUSED(ctx);
+    QOpenGLContext *glctx = QOpenGLContext::currentContext();
+    if (!glctx)
+        return nullptr;
+    return reinterpret_cast<void *>(glctx->getProcAddress(QByteArray(name)));
+}
+
+RenderThread::RenderThread(MpvWidget *widget, mpv_handle *mpv): widget(widget), mpv(mpv) {}
+
+RenderThread::~RenderThread() {
+    stop();
+    delete surface;
+}
+
+void RenderThread::start_rendering(QOpenGLContext *share) {
+    // The offscreen surface has to be created on the GUI thread.
+    surface = new QOffscreenSurface();
+    surface->setFormat(share->format());
+    surface->create();
+
+    ctx = new QOpenGLContext();
+    ctx->setFormat(share->format());
+    ctx->setShareContext(share);
+    if (!ctx->create())
+        throw std::runtime_error("failed to create shared GL context for render thread");
+    ctx->moveToThread(this);
+
+    blitter.create();
+    start();
+}
+
+void RenderThread::stop() {
+    if (!isRunning()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    cond.notify_one();
+    wait();
+    if (blitter.isCreated())
+        blitter.destroy();
+}
+
+void RenderThread::present() {
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    if (!front) return;
+
+    blitter.bind();
+    blitter.blit(front->texture(), QMatrix4x4(), QOpenGLTextureBlitter::OriginBottomLeft);
+    blitter.release();
+}
+
+void RenderThread::resize(QSize size, qreal dpr) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        target_size = size;
+        target_dpr = dpr;
+        redraw_pending = true;
+    }
+    cond.notify_one();
+}
+
+void RenderThread::request_redraw() {
+    wake(&redraw_pending);
+}
+
+void RenderThread::report_swap() {
+    wake(&swap_pending);
+}
+
+// Called by mpv from arbitrary threads; must not call back into mpv.
+void RenderThread::on_update(void *ctx) {
+    RenderThread *thread = (RenderThread *)ctx;
+    thread->wake(&thread->update_pending);
+}
+
+void RenderThread::wake(bool *flag) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        *flag = true;
+    }
+    cond.notify_one();
+}
+
+void RenderThread::run() {
+    ctx->makeCurrent(surface);
+
+    int advanced_control{1};
+    mpv_opengl_init_params gl_init_params[1] = {get_proc_address, nullptr};
+    mpv_render_param params[]{
+        {MPV_RENDER_PARAM_API_TYPE, const_cast<char *>(MPV_RENDER_API_TYPE_OPENGL)},
+        {MPV_RENDER_PARAM_OPENGL_INIT_PARAMS, &gl_init_params},
+        {MPV_RENDER_PARAM_ADVANCED_CONTROL, &advanced_control},
+        {MPV_RENDER_PARAM_INVALID, nullptr}
+    };
+
+    if (mpv_render_context_create(&mpv_gl, mpv, params) < 0) {
+        Log::write(LOG_LEVEL_ERROR, "render", "failed to initialize mpv GL context on render thread");
+        ctx->doneCurrent();
+        return;
+    }
+    mpv_render_context_set_update_callback(mpv_gl, RenderThread::on_update, this);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cond.wait(lock, [this] {
+            return quit || update_pending || redraw_pending || swap_pending;
+        });
+        if (quit) break;
+
+        bool swapped = swap_pending;
+        bool redraw = redraw_pending;
+        bool updated = update_pending;
+        update_pending = redraw_pending = swap_pending = false;
+        QSize size = target_size;
+        qreal dpr = target_dpr;
+        lock.unlock();
+
+        if (swapped)
+            mpv_render_context_report_swap(mpv_gl);
+
+        // With advanced control mpv_render_context_update() has to be called
+        // after every update callback, and its flags decide whether a new
+        // frame is due.
+        uint64_t flags = updated ? mpv_render_context_update(mpv_gl) : 0;
+        if ((flags & MPV_RENDER_UPDATE_FRAME) || redraw)
+            render(size, dpr);
+
+        lock.lock();
+    }
+    lock.unlock();
+
+    mpv_render_context_free(mpv_gl);
+    mpv_gl = nullptr;
+    {
+        std::lock_guard<std::mutex> frame_lock(frame_mutex);
+        delete front;
+        front = nullptr;
+    }
+    delete back;
+    back = nullptr;
+    ctx->doneCurrent();
+    delete ctx;
+    ctx = nullptr;
+}
+
+void RenderThread::render(QSize size, qreal dpr) {
+    if (size.isEmpty()) return;
+
+    if (!back || back->size() != size) {
+        delete back;
+        back = new QOpenGLFramebufferObject(size);
+    }
+
+    mpv_opengl_fbo mpfbo {
+        static_cast<int>(back->handle()),
+        size.width(),
+        size.height(),
+        0
+    };
+
+    int flip_y{1};
+
+    mpv_render_param params[] = {
+        {MPV_RENDER_PARAM_OPENGL_FBO, &mpfbo},
+        {MPV_RENDER_PARAM_FLIP_Y, &flip_y},
+        {MPV_RENDER_PARAM_INVALID, nullptr}
+    };
+
+    mpv_render_context_render(mpv_gl, params);
+
+    // Composite the disc overlay in the same pass.
+    back->bind();
+    {
+        QOpenGLPaintDevice device(size);
+        device.setDevicePixelRatio(dpr);
+        QPainter p(&device);
+        widget->draw_overlay(p, QSizeF(size) / dpr);
+    }
+    back->release();
+
+    // The widget samples the texture from another context.
+    ctx->functions()->glFinish();
+
+    {
+        std::lock_guard<std::mutex> frame_lock(frame_mutex);
+        std::swap(front, back);
+    }
+    QMetaObject::invokeMethod(widget, "update", Qt::QueuedConnection);
+}
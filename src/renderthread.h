@@ -0,0 +1,75 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <mutex>
+#include <condition_variable>
+
+#include <QThread>
+#include <QSize>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLTextureBlitter>
+#include <mpv/client.h>
+#include <mpv/render_gl.h>
+
+class MpvWidget;
+
+// Drives mpv_render_context_render() from its own thread, using a GL context
+// shared with the widget. Frames are rendered (video and disc overlay in the
+// same pass) into a double-buffered FBO; the widget only blits the latest
+// finished frame in paintGL(), so GUI-thread stalls no longer drop frames.
+//
+// The mpv render context is created with MPV_RENDER_PARAM_ADVANCED_CONTROL,
+// rendering is driven by the flags of mpv_render_context_update() and every
+// frame the widget actually swaps is passed back through
+// mpv_render_context_report_swap().
+class RenderThread : public QThread {
+    Q_OBJECT
+public:
+    RenderThread(MpvWidget *widget, mpv_handle *mpv);
+    ~RenderThread();
+
+    // GUI thread, with the widget's context current.
+    void start_rendering(QOpenGLContext *share);
+    void stop();
+    void present();
+
+    // Any thread.
+    void resize(QSize size, qreal dpr);
+    void request_redraw();
+    void report_swap();
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    static void on_update(void *ctx);
+    void wake(bool *flag);
+    void render(QSize size, qreal dpr);
+
+    MpvWidget *widget;
+    mpv_handle *mpv;
+    mpv_render_context *mpv_gl = nullptr;
+
+    QOpenGLContext *ctx = nullptr;
+    QOffscreenSurface *surface = nullptr;
+    QOpenGLTextureBlitter blitter;
+
+    // Guards the wake-up flags and the target size.
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool quit = false;
+    bool update_pending = false;
+    bool redraw_pending = false;
+    bool swap_pending = false;
+    QSize target_size;
+    qreal target_dpr = 1;
+
+    // Guards front; back is only touched by the render thread.
+    std::mutex frame_mutex;
+    QOpenGLFramebufferObject *front = nullptr;
+    QOpenGLFramebufferObject *back = nullptr;
+};
+
+#endif // RENDERTHREAD_H
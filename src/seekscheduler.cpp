@@ -0,0 +1,35 @@
+#include "seekscheduler.h"
+
+SeekScheduler::SeekScheduler(dispatch_fn dispatch): dispatch(dispatch) {}
+
+void SeekScheduler::request(double pos, bool exact) {
+    pending_pos = pos;
+    // An exact seek (slider release) must never be downgraded by a later
+    // keyframe request that is coalesced with it.
+    pending_exact = pending ? pending_exact || exact : exact;
+    pending = true;
+
+    if (!in_flight)
+        dispatch_pending();
+}
+
+void SeekScheduler::playback_restart() {
+    in_flight = false;
+    dispatch_pending();
+}
+
+void SeekScheduler::command_failed() {
+    in_flight = false;
+    dispatch_pending();
+}
+
+void SeekScheduler::reset() {
+    in_flight = false;
+    pending = false;
+}
+
+void SeekScheduler::dispatch_pending() {
+    if (!pending) return;
+    pending = false;
+    in_flight = dispatch(pending_pos, pending_exact);
+}
@@ -0,0 +1,34 @@
+#ifndef SEEKSCHEDULER_H
+#define SEEKSCHEDULER_H
+
+#include <functional>
+
+// Coalesces seek requests so that at most one seek is in flight at a time.
+// Every new request replaces the pending target; the pending target is only
+// dispatched once the previous seek has finished (MPV_EVENT_PLAYBACK_RESTART
+// or a failed command reply). All methods must be called from the GUI thread.
+class SeekScheduler {
+public:
+    // Called with the title-relative target in seconds. Returns true if a
+    // seek was started and a PLAYBACK_RESTART is expected to follow.
+    typedef std::function<bool(double pos, bool exact)> dispatch_fn;
+
+    explicit SeekScheduler(dispatch_fn dispatch);
+
+    void request(double pos, bool exact);
+    void playback_restart();
+    void command_failed();
+    void reset();
+    bool busy() const { return in_flight; }
+
+private:
+    void dispatch_pending();
+
+    dispatch_fn dispatch;
+    bool in_flight = false;
+    bool pending = false;
+    bool pending_exact = false;
+    double pending_pos = 0;
+};
+
+#endif // SEEKSCHEDULER_H
@@ -0,0 +1,195 @@
+#include "soundeffects.h"
+#include "log.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <algorithm>
+
+#include <QAudioFormat>
+#include <QAudioDevice>
+#include <QMediaDevices>
+
+// Keep the sink buffer short so that a trigger becomes audible quickly; as
+// the sink does not wait for the GUI thread, this bounds the
+// trigger-to-audible latency to roughly one buffer.
+static const int BUFFER_MS = 20;
+
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SoundEffects::SoundEffects(QObject *parent): QIODevice(parent) {
+    audio_thread.setObjectName("sound");
+    audio_context.moveToThread(&audio_thread);
+    audio_thread.start();
+}
+
+SoundEffects::~SoundEffects() {
+    unload();
+    audio_thread.quit();
+    audio_thread.wait();
+}
+
+void SoundEffects::load(BLURAY *bd) {
+    unload();
+
+    // Count the effects first so that the pool is allocated exactly once.
+    struct bd_sound_effect effect;
+    uint64_t total_frames = 0;
+    unsigned count = 0;
+    while (bd_get_sound_effect(bd, count, &effect) > 0) {
+        total_frames += effect.num_frames;
+        count++;
+    }
+    if (count == 0) return;
+
+    pool.resize(total_frames * CHANNELS);
+    effects.reserve(count);
+    pool_charge.resize(pool.capacity() * sizeof(int16_t) + effects.capacity() * sizeof(effect_t));
+
+    uint32_t offset = 0;
+    for (unsigned id = 0; id < count; id++) {
+        if (bd_get_sound_effect(bd, id, &effect) <= 0)
+            break;
+
+        // Effects are 16-bit 48 kHz LPCM, mono or interleaved stereo;
+        // store everything as stereo so the mixer has a single format.
+        int16_t *dst = &pool[offset * CHANNELS];
+        if (effect.num_channels == 2) {
+            memcpy(dst, effect.samples, effect.num_frames * CHANNELS * sizeof(int16_t));
+        } else {
+            for (uint32_t i = 0; i < effect.num_frames; i++)
+                dst[i * 2] = dst[i * 2 + 1] = effect.samples[i * effect.num_channels];
+        }
+
+        effects.push_back(effect_t({ .offset = offset, .frames = effect.num_frames }));
+        offset += effect.num_frames;
+    }
+    Log::write(LOG_LEVEL_INFO, "sound", "Loaded %u sound effects (%" PRIu64 " frames)", count, total_frames);
+
+    QAudioFormat format;
+    format.setSampleRate(SAMPLE_RATE);
+    format.setChannelCount(CHANNELS);
+    format.setSampleFormat(QAudioFormat::Int16);
+
+    open(QIODevice::ReadOnly);
+    QAudioDevice device = QMediaDevices::defaultAudioOutput();
+    QMetaObject::invokeMethod(&audio_context, [this, device, format]() {
+        sink = new QAudioSink(device, format);
+        sink->setBufferSize(format.bytesForDuration(BUFFER_MS * 1000));
+        sink->start(this);
+        buffer_bytes = sink->bufferSize();
+    }, Qt::BlockingQueuedConnection);
+}
+
+void SoundEffects::unload() {
+    // Once this returns, readData() is not running and the pool and voices
+    // can be reset.
+    if (sink) {
+        QMetaObject::invokeMethod(&audio_context, [this]() {
+            sink->stop();
+            delete sink;
+            sink = nullptr;
+        }, Qt::BlockingQueuedConnection);
+    }
+    if (isOpen())
+        close();
+
+    pool.clear();
+    pool.shrink_to_fit();
+    effects.clear();
+    effects.shrink_to_fit();
+    pool_charge.resize(0);
+    queue_head = 0;
+    queue_tail = 0;
+    std::fill(std::begin(voices), std::end(voices), voice_t());
+}
+
+void SoundEffects::trigger(uint32_t id) {
+    uint32_t head = queue_head.load(std::memory_order_relaxed);
+    if (head - queue_tail.load(std::memory_order_acquire) == QUEUE_SIZE)
+        return; // Full; dropping an effect beats blocking navigation.
+
+    queue[head % QUEUE_SIZE] = trigger_t({ .id = id, .trigger_ns = now_ns() });
+    queue_head.store(head + 1, std::memory_order_release);
+}
+
+sound_latency_t SoundEffects::latency() const {
+    uint64_t count = latency_count;
+    return sound_latency_t({
+        .triggered = count,
+        .mean_ms = count ? latency_sum_us / 1000.0 / count : 0,
+        .max_ms = latency_max_us / 1000.0
+    });
+}
+
+void SoundEffects::reset_latency() {
+    latency_count = 0;
+    latency_sum_us = 0;
+    latency_max_us = 0;
+}
+
+qint64 SoundEffects::readData(char *data, qint64 maxlen) {
+    uint32_t frames = maxlen / (CHANNELS * sizeof(int16_t));
+    if (frames == 0) return 0;
+
+    // What is returned now plays after the rest of the sink buffer.
+    qint64 buffered = std::max<qint64>(0, buffer_bytes - maxlen);
+    int64_t queued_us = buffered * 1000000 / (SAMPLE_RATE * CHANNELS * sizeof(int16_t));
+
+    uint32_t tail = queue_tail.load(std::memory_order_relaxed);
+    uint32_t head = queue_head.load(std::memory_order_acquire);
+    int64_t now = now_ns();
+    for (; tail != head; tail++) {
+        const trigger_t &t = queue[tail % QUEUE_SIZE];
+        if (t.id >= effects.size())
+            continue;
+
+        // Take an idle voice; only if all of them are busy, cut off the
+        // one after the last taken.
+        int index = -1;
+        for (int i = 0; i < MAX_VOICES && index < 0; i++)
+            if (voices[i].remaining == 0)
+                index = i;
+        if (index < 0)
+            index = next_voice;
+        next_voice = (index + 1) % MAX_VOICES;
+        voice_t &voice = voices[index];
+        voice.samples = &pool[effects[t.id].offset * CHANNELS];
+        voice.remaining = effects[t.id].frames;
+
+        uint64_t latency_us = (now - t.trigger_ns) / 1000 + queued_us;
+        latency_count++;
+        latency_sum_us += latency_us;
+        if (latency_us > latency_max_us)
+            latency_max_us = latency_us;
+    }
+    queue_tail.store(tail, std::memory_order_release);
+
+    mix((int16_t *)data, frames);
+    return frames * CHANNELS * sizeof(int16_t);
+}
+
+qint64 SoundEffects::writeData(const char *data, qint64 len) {
+    Q_UNUSED(data);
+    Q_UNUSED(len);
+    return -1;
+}
+
+void SoundEffects::mix(int16_t *out, uint32_t frames) {
+    memset(out, 0, frames * CHANNELS * sizeof(int16_t));
+
+    for (voice_t &voice : voices) {
+        if (!voice.remaining) continue;
+
+        uint32_t n = std::min(frames, voice.remaining) * CHANNELS;
+        for (uint32_t i = 0; i < n; i++) {
+            int32_t sample = out[i] + voice.samples[i];
+            out[i] = std::clamp<int32_t>(sample, INT16_MIN, INT16_MAX);
+        }
+        voice.samples += n;
+        voice.remaining -= n / CHANNELS;
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef SOUNDEFFECTS_H
+#define SOUNDEFFECTS_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+#include <libbluray/bluray.h>
+
+#include <QThread>
+#include <QIODevice>
+#include <QAudioSink>
+
+#include "memstats.h"
+
+typedef struct {
+    uint64_t triggered;
+    double mean_ms;
+    double max_ms;
+} sound_latency_t;
+
+// Plays the disc's menu sound effects (sound.bdmv). All effects are decoded
+// once at disc open into a single stereo 48 kHz pool; trigger() only pushes
+// the effect id onto a lock-free queue, and the audio sink's pull callback
+// mixes active effects straight out of the pool. Nothing is allocated and no
+// file is read when an effect fires. The sink runs on its own thread, so the
+// queue is drained while the GUI thread is blocked in libbluray navigation.
+class SoundEffects : public QIODevice {
+    Q_OBJECT
+public:
+    explicit SoundEffects(QObject *parent = 0);
+    ~SoundEffects();
+
+    // GUI thread.
+    void load(BLURAY *bd);
+    void unload();
+    // Navigation thread, O(1).
+    void trigger(uint32_t id);
+
+    sound_latency_t latency() const;
+    void reset_latency();
+
+    bool isSequential() const Q_DECL_OVERRIDE { return true; }
+protected:
+    qint64 readData(char *data, qint64 maxlen) Q_DECL_OVERRIDE;
+    qint64 writeData(const char *data, qint64 len) Q_DECL_OVERRIDE;
+private:
+    static const int CHANNELS = 2;
+    static const int SAMPLE_RATE = 48000;
+    static const int MAX_VOICES = 8;
+    static const uint32_t QUEUE_SIZE = 64;
+
+    typedef struct {
+        uint32_t offset;
+        uint32_t frames;
+    } effect_t;
+
+    typedef struct {
+        uint32_t id;
+        int64_t trigger_ns;
+    } trigger_t;
+
+    typedef struct {
+        const int16_t *samples;
+        uint32_t remaining;
+    } voice_t;
+
+    void mix(int16_t *out, uint32_t frames);
+
+    std::vector<int16_t> pool;
+    std::vector<effect_t> effects;
+    MemCharge pool_charge{MEM_SOUND_EFFECTS};
+    // The sink is created, driven and deleted on audio_thread, where
+    // audio_context lives; readData() runs there.
+    QThread audio_thread;
+    QObject audio_context;
+    QAudioSink *sink = nullptr;
+    std::atomic<qint64> buffer_bytes{0};
+
+    // Single-producer/single-consumer ring of pending triggers.
+    trigger_t queue[QUEUE_SIZE];
+    std::atomic<uint32_t> queue_head{0};
+    std::atomic<uint32_t> queue_tail{0};
+
+    // Only touched by the audio callback.
+    voice_t voices[MAX_VOICES] = {};
+    int next_voice = 0;
+
+    std::atomic<uint64_t> latency_count{0};
+    std::atomic<uint64_t> latency_sum_us{0};
+    std::atomic<uint64_t> latency_max_us{0};
+};
+
+#endif // SOUNDEFFECTS_H
@@ -0,0 +1,47 @@
+INCLUDEPATH += $$PWD
+
+HEADERS += \
+    $$PWD/mpvwidget.h \
+    $$PWD/mainwindow.h \
+    $$PWD/seekscheduler.h \
+    $$PWD/framestats.h \
+    $$PWD/renderthread.h \
+    $$PWD/swrenderer.h \
+    $$PWD/swvideoview.h \
+    $$PWD/eventthread.h \
+    $$PWD/cachecontroller.h \
+    $$PWD/bdclock.h \
+    $$PWD/overlayqueue.h \
+    $$PWD/overlaycache.h \
+    $$PWD/soundeffects.h \
+    $$PWD/overlay.h \
+    $$PWD/libraryscanner.h \
+    $$PWD/titleexporter.h \
+    $$PWD/playlistanalyzer.h \
+    $$PWD/discio.h \
+    $$PWD/keyframeindex.h \
+    $$PWD/log.h \
+    $$PWD/memstats.h \
+    $$PWD/bdresource.h
+SOURCES += \
+    $$PWD/mpvwidget.cpp \
+    $$PWD/mainwindow.cpp \
+    $$PWD/seekscheduler.cpp \
+    $$PWD/framestats.cpp \
+    $$PWD/renderthread.cpp \
+    $$PWD/swrenderer.cpp \
+    $$PWD/swvideoview.cpp \
+    $$PWD/eventthread.cpp \
+    $$PWD/cachecontroller.cpp \
+    $$PWD/bdclock.cpp \
+    $$PWD/overlayqueue.cpp \
+    $$PWD/overlaycache.cpp \
+    $$PWD/soundeffects.cpp \
+    $$PWD/overlay.cpp \
+    $$PWD/libraryscanner.cpp \
+    $$PWD/titleexporter.cpp \
+    $$PWD/playlistanalyzer.cpp \
+    $$PWD/discio.cpp \
+    $$PWD/keyframeindex.cpp \
+    $$PWD/log.cpp \
+    $$PWD/memstats.cpp
@@ -0,0 +1,329 @@
+#include "swrenderer.h"
+#include "mpvwidget.h"
+#include "log.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Canvas rows start on 64-byte boundaries, which mpv's SW renderer and the
+// blend loops are fastest with.
+static const size_t ALIGN = 64;
+
+// x * a / 255, rounded, for x and a in 0..255.
+static inline uint32_t mul_div255(uint32_t x, uint32_t a) {
+    uint32_t t = x * a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static inline uint32_t blend_pixel(uint32_t dst, uint32_t src) {
+    uint32_t inv = 255 - (src >> 24);
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+        result |= ((src >> shift & 0xff) + mul_div255(dst >> shift & 0xff, inv)) << shift;
+    return result;
+}
+
+void sw_blend(uint32_t *dst, const uint32_t *src, int count) {
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i c128 = _mm_set1_epi16(128);
+    const __m128i opaque = _mm_set1_epi32(255);
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        // Menus are mostly fully transparent or fully opaque.
+        __m128i alpha = _mm_srli_epi32(s, 24);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) == 0xffff)
+            continue;
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, opaque)) == 0xffff) {
+            _mm_storeu_si128((__m128i *)(dst + i), s);
+            continue;
+        }
+
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+        __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+        __m128i inv_lo = _mm_sub_epi16(c255, _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0xff), 0xff));
+        __m128i inv_hi = _mm_sub_epi16(c255, _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0xff), 0xff));
+        __m128i d_lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inv_lo), c128);
+        __m128i d_hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inv_hi), c128);
+        d_lo = _mm_srli_epi16(_mm_add_epi16(d_lo, _mm_srli_epi16(d_lo, 8)), 8);
+        d_hi = _mm_srli_epi16(_mm_add_epi16(d_hi, _mm_srli_epi16(d_hi, 8)), 8);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_adds_epu8(s, _mm_packus_epi16(d_lo, d_hi)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t s = vld4_u8((const uint8_t *)(src + i));
+        uint8x8x4_t d = vld4_u8((const uint8_t *)(dst + i));
+        uint8x8_t inv = vmvn_u8(s.val[3]);
+        for (int c = 0; c < 4; c++) {
+            uint16x8_t t = vmull_u8(d.val[c], inv);
+            d.val[c] = vqadd_u8(s.val[c], vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+        }
+        vst4_u8((uint8_t *)(dst + i), d);
+    }
+#endif
+    for (; i < count; i++)
+        dst[i] = blend_pixel(dst[i], src[i]);
+}
+
+SwRenderer::SwRenderer(MpvWidget *widget, mpv_handle *mpv, std::function<void()> presented):
+    widget(widget), mpv(mpv), presented(presented) {
+    QByteArray path = qgetenv("MPV_BD_SW_SINK");
+    if (!path.isEmpty()) {
+        sink = fopen(path.constData(), "wb");
+        if (!sink)
+            Log::write(LOG_LEVEL_ERROR, "render", "Cannot open %s", path.constData());
+    }
+    since_reset.start();
+}
+
+SwRenderer::~SwRenderer() {
+    stop();
+    if (sink)
+        fclose(sink);
+}
+
+void SwRenderer::stop() {
+    if (!isRunning()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    cond.notify_one();
+    wait();
+}
+
+void SwRenderer::resize(QSize size, qreal dpr) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        target_size = size;
+        target_dpr = dpr;
+        redraw_pending = true;
+    }
+    cond.notify_one();
+}
+
+void SwRenderer::request_redraw() {
+    wake(&redraw_pending);
+}
+
+// Called by mpv from arbitrary threads; must not call back into mpv.
+void SwRenderer::on_update(void *ctx) {
+    SwRenderer *renderer = (SwRenderer *)ctx;
+    renderer->wake(&renderer->update_pending);
+}
+
+void SwRenderer::wake(bool *flag) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        *flag = true;
+    }
+    cond.notify_one();
+}
+
+void SwRenderer::allocate(buffer_t &buffer, QSize size) {
+    buffer.stride = ((size_t)size.width() * 4 + ALIGN - 1) / ALIGN * ALIGN;
+    buffer.data.reset((uint8_t *)std::aligned_alloc(ALIGN, buffer.stride * size.height()));
+    buffer.size = size;
+}
+
+void SwRenderer::copy_row(buffer_t &to, const buffer_t &from, int y) const {
+    memcpy(to.data.get() + y * to.stride, from.data.get() + y * from.stride, (size_t)from.size.width() * 4);
+}
+
+void SwRenderer::run() {
+    mpv_render_param params[]{
+        {MPV_RENDER_PARAM_API_TYPE, const_cast<char *>(MPV_RENDER_API_TYPE_SW)},
+        {MPV_RENDER_PARAM_INVALID, nullptr}
+    };
+
+    if (mpv_render_context_create(&mpv_sw, mpv, params) < 0) {
+        Log::write(LOG_LEVEL_ERROR, "render", "failed to initialize mpv software render context");
+        return;
+    }
+    mpv_render_context_set_update_callback(mpv_sw, SwRenderer::on_update, this);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cond.wait(lock, [this] {
+            return quit || update_pending || redraw_pending;
+        });
+        if (quit) break;
+
+        bool redraw = redraw_pending;
+        bool updated = update_pending;
+        update_pending = redraw_pending = false;
+        QSize size = target_size;
+        qreal dpr = target_dpr;
+        lock.unlock();
+
+        uint64_t flags = updated ? mpv_render_context_update(mpv_sw) : 0;
+        if ((flags & MPV_RENDER_UPDATE_FRAME) || redraw)
+            update(flags & MPV_RENDER_UPDATE_FRAME, size, dpr);
+
+        lock.lock();
+    }
+    lock.unlock();
+
+    mpv_render_context_free(mpv_sw);
+    mpv_sw = nullptr;
+}
+
+void SwRenderer::mark_rows(const OverlayCache::scaled_graphics_t &graphics, std::vector<uint8_t> &rows) const {
+    if (!graphics) return;
+    for (const scaled_graphic_t &graphic : *graphics) {
+        int top = std::max(graphic.pos.y(), 0);
+        int bottom = std::min(graphic.pos.y() + graphic.image.height(), (int)rows.size());
+        for (int y = top; y < bottom; y++)
+            rows[y] = 1;
+    }
+}
+
+void SwRenderer::blend(const OverlayCache::scaled_graphics_t &graphics) {
+    if (!graphics) return;
+    int width = canvas.size.width();
+    int height = canvas.size.height();
+    for (const scaled_graphic_t &graphic : *graphics) {
+        int left = std::max(graphic.pos.x(), 0);
+        int right = std::min(graphic.pos.x() + graphic.image.width(), width);
+        int top = std::max(graphic.pos.y(), 0);
+        int bottom = std::min(graphic.pos.y() + graphic.image.height(), height);
+        if (left >= right) continue;
+        for (int y = top; y < bottom; y++) {
+            const uint32_t *src = (const uint32_t *)graphic.image.constScanLine(y - graphic.pos.y());
+            uint32_t *dst = (uint32_t *)(canvas.data.get() + y * canvas.stride);
+            sw_blend(dst + left, src + (left - graphic.pos.x()), right - left);
+        }
+    }
+}
+
+void SwRenderer::update(bool render_video, QSize size, qreal dpr) {
+    if (size.isEmpty()) return;
+
+    QElapsedTimer timer;
+    timer.start();
+    if (canvas.size != size) {
+        allocate(canvas, size);
+        allocate(saved, size);
+        blended_rows.assign(size.height(), 0);
+        render_video = true;
+        Log::write(LOG_LEVEL_V, "render", "Software frames are %dx%d, stride %zu",
+            size.width(), size.height(), canvas.stride);
+    }
+
+    double frame_render_ms = 0;
+    if (render_video) {
+        int sw_size[2] = { size.width(), size.height() };
+        size_t stride = canvas.stride;
+        mpv_render_param params[] = {
+            {MPV_RENDER_PARAM_SW_SIZE, sw_size},
+            {MPV_RENDER_PARAM_SW_FORMAT, const_cast<char *>("bgr0")},
+            {MPV_RENDER_PARAM_SW_STRIDE, &stride},
+            {MPV_RENDER_PARAM_SW_POINTER, canvas.data.get()},
+            {MPV_RENDER_PARAM_INVALID, nullptr}
+        };
+        mpv_render_context_render(mpv_sw, params);
+        // Every row is clean video again.
+        std::fill(blended_rows.begin(), blended_rows.end(), 0);
+        frame_render_ms = timer.nsecsElapsed() / 1e6;
+        timer.restart();
+    }
+
+    // Keep the previous overlay until the cache has caught up with a change.
+    bool pending = false;
+    OverlayCache::scaled_graphics_t next = widget->scaled_overlay(size, dpr, &pending);
+    if (pending)
+        next = overlay;
+    if (!render_video && next == overlay)
+        return;
+
+    std::vector<uint8_t> rows(size.height(), 0);
+    mark_rows(next, rows);
+    // Rows that change: everything after a new video frame, otherwise the
+    // rows under the old and the new overlay.
+    std::vector<uint8_t> dirty = render_video ? std::vector<uint8_t>(size.height(), 1) : rows;
+    uint64_t touched = 0;
+    for (int y = 0; y < size.height(); y++) {
+        if (blended_rows[y]) {
+            copy_row(canvas, saved, y);
+            dirty[y] = 1;
+        }
+        if (rows[y])
+            copy_row(saved, canvas, y);
+        touched += blended_rows[y] | rows[y];
+    }
+    overlay = next;
+    blend(overlay);
+    blended_rows.swap(rows);
+    double frame_blend_ms = timer.nsecsElapsed() / 1e6;
+
+    {
+        std::lock_guard<std::mutex> lock(frame_mutex);
+        if (front.size != size)
+            allocate(front, size);
+        for (int y = 0; y < size.height(); y++) {
+            if (dirty[y])
+                copy_row(front, canvas, y);
+        }
+        front_dpr = dpr;
+    }
+    if (sink) {
+        for (int y = 0; y < size.height(); y++)
+            fwrite(canvas.data.get() + y * canvas.stride, 4, size.width(), sink);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        if (render_video)
+            frame_count++;
+        else
+            redraw_count++;
+        rows_updated += touched;
+        render_ms += frame_render_ms;
+        blend_ms += frame_blend_ms;
+    }
+    presented();
+}
+
+void SwRenderer::present(QPainter &p, QRectF target) {
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    if (!front.data) return;
+
+    QImage image((const uchar *)front.data.get(), front.size.width(), front.size.height(),
+                 front.stride, QImage::Format_RGB32);
+    image.setDevicePixelRatio(front_dpr);
+    p.drawImage(target, image);
+}
+
+sw_render_stats_t SwRenderer::stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    uint64_t updates = frame_count + redraw_count;
+    double seconds = since_reset.nsecsElapsed() / 1e9;
+    return sw_render_stats_t({
+        .frames = frame_count,
+        .redraws = redraw_count,
+        .fps = seconds > 0 ? frame_count / seconds : 0,
+        .mean_render_ms = frame_count ? render_ms / frame_count : 0,
+        .mean_blend_ms = updates ? blend_ms / updates : 0,
+        .rows_per_update = updates ? (double)rows_updated / updates : 0
+    });
+}
+
+void SwRenderer::reset_stats() {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    frame_count = 0;
+    redraw_count = 0;
+    rows_updated = 0;
+    render_ms = 0;
+    blend_ms = 0;
+    since_reset.restart();
+}
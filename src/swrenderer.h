@@ -0,0 +1,122 @@
+#ifndef SWRENDERER_H
+#define SWRENDERER_H
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+#include <QThread>
+#include <QSize>
+#include <QImage>
+#include <QPainter>
+#include <QElapsedTimer>
+#include <mpv/client.h>
+#include <mpv/render.h>
+
+#include "overlaycache.h"
+
+class MpvWidget;
+
+// Blends count premultiplied ARGB32 pixels of src over dst (RGB32, same
+// byte order) in place: SSE2 or NEON where available, scalar otherwise.
+void sw_blend(uint32_t *dst, const uint32_t *src, int count);
+
+typedef struct {
+    // Video frames rendered, and updates of the overlay alone.
+    uint64_t frames;
+    uint64_t redraws;
+    double fps;
+    double mean_render_ms;
+    double mean_blend_ms;
+    // Rows restored and re-blended per update.
+    double rows_per_update;
+} sw_render_stats_t;
+
+// Renders with mpv's software render API (MPV_RENDER_API_TYPE_SW) on its own
+// thread, for hosts without a usable GPU. mpv draws into a 64-byte aligned
+// canvas that is reused across frames; the disc overlay, prescaled by
+// OverlayCache, is blended into it afterwards. The rows under the overlay
+// are saved before blending, so an overlay change on a still frame (menu
+// navigation) restores and re-blends only the rows it touches instead of
+// rendering the video again. Finished rows are copied to the presented
+// frame, which a plain QWidget paints, and optionally written to a file as
+// raw BGRA frames (MPV_BD_SW_SINK) for headless use.
+class SwRenderer : public QThread {
+    Q_OBJECT
+public:
+    // presented is called on the render thread after each update.
+    SwRenderer(MpvWidget *widget, mpv_handle *mpv, std::function<void()> presented);
+    ~SwRenderer();
+
+    void stop();
+
+    // Any thread.
+    void resize(QSize size, qreal dpr);
+    void request_redraw();
+
+    // GUI thread: paints the last presented frame into target.
+    void present(QPainter &p, QRectF target);
+
+    sw_render_stats_t stats() const;
+    void reset_stats();
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    typedef struct {
+        std::unique_ptr<uint8_t, void (*)(void *)> data;
+        QSize size;
+        size_t stride;
+    } buffer_t;
+
+    static void on_update(void *ctx);
+    static void allocate(buffer_t &buffer, QSize size);
+    void wake(bool *flag);
+    void update(bool render_video, QSize size, qreal dpr);
+    void mark_rows(const OverlayCache::scaled_graphics_t &overlay, std::vector<uint8_t> &rows) const;
+    void blend(const OverlayCache::scaled_graphics_t &overlay);
+    void copy_row(buffer_t &to, const buffer_t &from, int y) const;
+
+    MpvWidget *widget;
+    mpv_handle *mpv;
+    mpv_render_context *mpv_sw = nullptr;
+    std::function<void()> presented;
+    FILE *sink = nullptr;
+
+    // Guards the wake-up flags and the target size.
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool quit = false;
+    bool update_pending = false;
+    bool redraw_pending = false;
+    QSize target_size;
+    qreal target_dpr = 1;
+
+    // Render thread only: the canvas mpv renders into, the clean video
+    // rows under the overlay, and which rows are currently blended.
+    buffer_t canvas = { { nullptr, free }, QSize(), 0 };
+    buffer_t saved = { { nullptr, free }, QSize(), 0 };
+    std::vector<uint8_t> blended_rows;
+    OverlayCache::scaled_graphics_t overlay;
+
+    // Guards front.
+    mutable std::mutex frame_mutex;
+    buffer_t front = { { nullptr, free }, QSize(), 0 };
+    qreal front_dpr = 1;
+
+    mutable std::mutex stats_mutex;
+    QElapsedTimer since_reset;
+    uint64_t frame_count = 0;
+    uint64_t redraw_count = 0;
+    uint64_t rows_updated = 0;
+    double render_ms = 0;
+    double blend_ms = 0;
+};
+
+#endif // SWRENDERER_H
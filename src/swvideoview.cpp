@@ -0,0 +1,44 @@
+#include "swvideoview.h"
+#include "mpvwidget.h"
+
+#include <QPainter>
+#include <QCoreApplication>
+
+SwVideoView::SwVideoView(MpvWidget *player, QWidget *parent): QWidget(parent), player(player) {
+    setFocusPolicy(Qt::StrongFocus);
+    setMouseTracking(true);
+    // Every pixel is painted from the frame.
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    connect(player, &MpvWidget::softwareFrame, this, QOverload<>::of(&QWidget::update));
+}
+
+QSize SwVideoView::sizeHint() const {
+    return player->sizeHint();
+}
+
+void SwVideoView::paintEvent(QPaintEvent *event) {
+    Q_UNUSED(event);
+    QPainter p(this);
+    player->present_software(p, rect());
+}
+
+void SwVideoView::resizeEvent(QResizeEvent *event) {
+    Q_UNUSED(event);
+    player->resize_software(size(), devicePixelRatioF());
+}
+
+void SwVideoView::keyPressEvent(QKeyEvent *event) {
+    QCoreApplication::sendEvent(player, event);
+}
+
+void SwVideoView::mouseMoveEvent(QMouseEvent *event) {
+    QCoreApplication::sendEvent(player, event);
+}
+
+void SwVideoView::mousePressEvent(QMouseEvent *event) {
+    QCoreApplication::sendEvent(player, event);
+}
+
+void SwVideoView::mouseDoubleClickEvent(QMouseEvent *event) {
+    QCoreApplication::sendEvent(player, event);
+}
@@ -0,0 +1,28 @@
+#ifndef SWVIDEOVIEW_H
+#define SWVIDEOVIEW_H
+
+#include <QWidget>
+
+class MpvWidget;
+
+// Shows the frames of the software render backend in a plain QWidget, so
+// that the window needs no OpenGL. The player stays an off-screen
+// MpvWidget: input is forwarded to it and it is kept at the size of the
+// view, so menu hit testing works unchanged.
+class SwVideoView : public QWidget {
+    Q_OBJECT
+public:
+    explicit SwVideoView(MpvWidget *player, QWidget *parent = 0);
+    QSize sizeHint() const Q_DECL_OVERRIDE;
+protected:
+    void paintEvent(QPaintEvent *event) Q_DECL_OVERRIDE;
+    void resizeEvent(QResizeEvent *event) Q_DECL_OVERRIDE;
+    void keyPressEvent(QKeyEvent *event) Q_DECL_OVERRIDE;
+    void mouseMoveEvent(QMouseEvent *event) Q_DECL_OVERRIDE;
+    void mousePressEvent(QMouseEvent *event) Q_DECL_OVERRIDE;
+    void mouseDoubleClickEvent(QMouseEvent *event) Q_DECL_OVERRIDE;
+private:
+    MpvWidget *player;
+};
+
+#endif // SWVIDEOVIEW_H
@@ -0,0 +1,347 @@
+#include "titleexporter.h"
+#include "playlistanalyzer.h"
+#include "bdresource.h"
+#include "bdclock.h"
+#include "discio.h"
+#include "log.h"
+
+#include <memory>
+#include <cstdio>
+#include <cinttypes>
+#include <algorithm>
+
+#include <mpv/client.h>
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QTemporaryFile>
+#include <QtConcurrent/QtConcurrentMap>
+
+struct mpv_destroy_deleter {
+    void operator()(mpv_handle *mpv) const { mpv_terminate_destroy(mpv); }
+};
+typedef std::unique_ptr<mpv_handle, mpv_destroy_deleter> mpv_ptr;
+
+struct av_input_deleter {
+    void operator()(AVFormatContext *ctx) const { avformat_close_input(&ctx); }
+};
+struct av_output_deleter {
+    void operator()(AVFormatContext *ctx) const {
+        if (!(ctx->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&ctx->pb);
+        avformat_free_context(ctx);
+    }
+};
+struct av_packet_deleter {
+    void operator()(AVPacket *packet) const { av_packet_free(&packet); }
+};
+typedef std::unique_ptr<AVFormatContext, av_input_deleter> av_input_ptr;
+typedef std::unique_ptr<AVFormatContext, av_output_deleter> av_output_ptr;
+typedef std::unique_ptr<AVPacket, av_packet_deleter> av_packet_ptr;
+
+static av_input_ptr open_input(const QString &path, const AVInputFormat *format) {
+    AVFormatContext *ctx = NULL;
+    if (avformat_open_input(&ctx, path.toUtf8().data(), format, NULL) < 0)
+        return nullptr;
+    av_input_ptr input(ctx);
+    if (format == NULL && avformat_find_stream_info(ctx, NULL) < 0)
+        return nullptr;
+    return input;
+}
+
+TitleExporter::TitleExporter(int workers):
+    workers(workers > 0 ? workers : QThread::idealThreadCount()) {}
+
+std::vector<export_result_t> TitleExporter::run(const std::vector<export_job_t> &jobs) const {
+    QThreadPool pool;
+    pool.setMaxThreadCount(workers);
+    std::vector<export_result_t> results(jobs.size());
+    std::vector<size_t> indices(jobs.size());
+    for (size_t i = 0; i < indices.size(); i++)
+        indices[i] = i;
+    QtConcurrent::blockingMap(&pool, indices, [&](size_t i) {
+        results[i] = export_title(jobs[i]);
+    });
+    return results;
+}
+
+// 1-based stream number for wanted, 0 for none, -1 if there is no such stream.
+int TitleExporter::select_stream(const QString &wanted, const BLURAY_STREAM_INFO *streams, uint8_t count) {
+    if (wanted.isEmpty() || wanted == "no")
+        return 0;
+    bool number;
+    int stream = wanted.toInt(&number);
+    if (number)
+        return stream >= 1 && stream <= count ? stream : -1;
+    for (uint8_t i = 0; i < count; i++) {
+        if (wanted.compare(QString::fromLatin1((const char *)streams[i].lang), Qt::CaseInsensitive) == 0)
+            return i + 1;
+    }
+    return -1;
+}
+
+// An edl:// URL with one segment per play item, cut to its in/out range.
+// Clips are opened without rebase-start-time, so start is the stream pts.
+// Paths are length-prefixed, as ISO stream URLs contain separators.
+QByteArray TitleExporter::timeline(const BLURAY_TITLE_INFO &title, const DiscIO *io) {
+    QByteArray edl = "edl://";
+    for (uint32_t i = 0; i < title.clip_count; i++) {
+        const BLURAY_CLIP_INFO &clip = title.clips[i];
+        if (clip.out_time <= clip.in_time)
+            continue;
+        QByteArray url = io->stream_url("BDMV/STREAM/" + QString::fromUtf8(clip.clip_id) + ".m2ts").toUtf8();
+        if (edl.size() > 6)
+            edl += ";";
+        edl += "%" + QByteArray::number(url.size()) + "%" + url;
+        edl += ",start=" + QByteArray::number(BdClock::seconds(clip.in_time), 'f', 6);
+        edl += ",length=" + QByteArray::number(BdClock::seconds(clip.out_time - clip.in_time), 'f', 6);
+    }
+    return edl;
+}
+
+// The chapter marks as FFmpeg metadata. Their title times are positions on
+// the timeline, which plays the play items back to back.
+QByteArray TitleExporter::chapters(const BLURAY_TITLE_INFO &title) {
+    QByteArray meta = ";FFMETADATA1\n";
+    for (uint32_t i = 0; i < title.chapter_count; i++) {
+        const BLURAY_TITLE_CHAPTER &chapter = title.chapters[i];
+        if (chapter.start >= title.duration)
+            break;
+        uint64_t end = i + 1 < title.chapter_count ? title.chapters[i + 1].start : title.duration;
+        meta += "[CHAPTER]\nTIMEBASE=1/" + QByteArray::number((qulonglong)BdClock::RATE) + "\n";
+        meta += "START=" + QByteArray::number((qulonglong)chapter.start) + "\n";
+        meta += "END=" + QByteArray::number((qulonglong)std::min(end, title.duration)) + "\n";
+        meta += "title=Chapter " + QByteArray::number(i + 1) + "\n";
+    }
+    return meta;
+}
+
+// Copies the recording into output with the chapters added. mpv's recorder
+// only writes the packets of the selected streams, so this is where the
+// chapter marks get into the file. They are shifted to the start time of the
+// recording, which is where the title starts.
+bool TitleExporter::mux_chapters(const QString &recorded, const QString &chapters, const QString &output) {
+    av_input_ptr input = open_input(recorded, NULL);
+    av_input_ptr meta = open_input(chapters, av_find_input_format("ffmetadata"));
+    if (input == NULL || meta == NULL)
+        return false;
+
+    AVFormatContext *ctx = NULL;
+    if (avformat_alloc_output_context2(&ctx, NULL, NULL, output.toUtf8().data()) < 0)
+        return false;
+    av_output_ptr out(ctx);
+    av_dict_copy(&out->metadata, input->metadata, 0);
+
+    for (unsigned i = 0; i < input->nb_streams; i++) {
+        const AVStream *from = input->streams[i];
+        AVStream *to = avformat_new_stream(out.get(), NULL);
+        if (to == NULL || avcodec_parameters_copy(to->codecpar, from->codecpar) < 0)
+            return false;
+        to->codecpar->codec_tag = 0;
+        to->time_base = from->time_base;
+        to->disposition = from->disposition;
+        av_dict_copy(&to->metadata, from->metadata, 0);
+    }
+
+    // Owned by out from here on, freed by avformat_free_context().
+    int64_t start = input->start_time == AV_NOPTS_VALUE ? 0 : input->start_time;
+    if (meta->nb_chapters) {
+        out->chapters = (AVChapter **)av_calloc(meta->nb_chapters, sizeof(AVChapter *));
+        if (out->chapters == NULL)
+            return false;
+    }
+    for (unsigned i = 0; i < meta->nb_chapters; i++) {
+        const AVChapter *from = meta->chapters[i];
+        AVChapter *to = (AVChapter *)av_mallocz(sizeof(AVChapter));
+        if (to == NULL)
+            return false;
+        int64_t offset = av_rescale_q(start, AVRational{1, AV_TIME_BASE}, from->time_base);
+        to->id = from->id;
+        to->time_base = from->time_base;
+        to->start = from->start + offset;
+        to->end = from->end + offset;
+        av_dict_copy(&to->metadata, from->metadata, 0);
+        out->chapters[out->nb_chapters++] = to;
+    }
+
+    if (!(out->oformat->flags & AVFMT_NOFILE) &&
+        avio_open(&out->pb, output.toUtf8().data(), AVIO_FLAG_WRITE) < 0)
+        return false;
+    if (avformat_write_header(out.get(), NULL) < 0)
+        return false;
+
+    auto write = [&](AVPacket *packet) {
+        int stream = packet->stream_index;
+        av_packet_rescale_ts(packet, input->streams[stream]->time_base, out->streams[stream]->time_base);
+        packet->pos = -1;
+        return av_interleaved_write_frame(out.get(), packet) >= 0;
+    };
+
+    // With reordered frames the Matroska demuxer leaves the dts of the first
+    // few unset. They are held back until the first known dts and numbered
+    // back from it, rather than left to the muxer's deprecated guessing.
+    std::vector<std::vector<av_packet_ptr>> held(input->nb_streams);
+    std::vector<uint8_t> dts_known(input->nb_streams);
+    av_packet_ptr packet(av_packet_alloc());
+    if (packet == NULL)
+        return false;
+    while (av_read_frame(input.get(), packet.get()) >= 0) {
+        int stream = packet->stream_index;
+        if (!dts_known[stream] && packet->dts == AV_NOPTS_VALUE) {
+            held[stream].emplace_back(av_packet_clone(packet.get()));
+            av_packet_unref(packet.get());
+            if (held[stream].back() == NULL)
+                return false;
+            continue;
+        }
+        dts_known[stream] = true;
+        for (size_t i = 0; i < held[stream].size(); i++) {
+            AVPacket *early = held[stream][i].get();
+            int64_t step = early->duration > 0 ? early->duration : 1;
+            early->dts = packet->dts - (int64_t)(held[stream].size() - i) * step;
+            if (!write(early))
+                return false;
+        }
+        held[stream].clear();
+        if (!write(packet.get()))
+            return false;
+    }
+    // Streams that never had a dts.
+    for (std::vector<av_packet_ptr> &early : held) {
+        for (av_packet_ptr &p : early) {
+            p->dts = p->pts;
+            if (!write(p.get()))
+                return false;
+        }
+    }
+    return av_write_trailer(out.get()) >= 0;
+}
+
+// Runs on a pool thread with its own BLURAY and mpv instance.
+export_result_t TitleExporter::export_title(const export_job_t &job) {
+    export_result_t result = {};
+    QElapsedTimer timer;
+    timer.start();
+
+    std::unique_ptr<DiscIO> io(DiscIO::open(job.disc));
+    bd_ptr bd(io ? io->open_bluray() : NULL);
+    const BLURAY_DISC_INFO *disc_info = bd ? bd_get_disc_info(bd.get()) : NULL;
+    if (!disc_info || !disc_info->bluray_detected) {
+        result.error = "not a Blu-ray disc";
+        return result;
+    }
+
+    result.playlist = job.playlist;
+    if (job.main_feature) {
+        std::vector<playlist_candidate_t> candidates = PlaylistAnalyzer::analyze(bd.get());
+        if (candidates.empty()) {
+            result.error = "no main feature found";
+            return result;
+        }
+        result.playlist = candidates[0].playlist;
+    }
+    title_info_ptr title(bd_get_playlist_info(bd.get(), result.playlist, 0));
+    if (!title || !title->clip_count) {
+        result.error = QString::asprintf("no playlist %05u.mpls", result.playlist);
+        return result;
+    }
+    result.clips = title->clip_count;
+    result.chapters = title->chapter_count;
+    result.duration = title->duration;
+
+    // The first play item's stream table numbers the streams like the
+    // stream selection of the player does.
+    const BLURAY_CLIP_INFO &first = title->clips[0];
+    QString audio = job.audio.isEmpty() && first.audio_stream_count ? QString("1") : job.audio;
+    int aid = select_stream(audio, first.audio_streams, first.audio_stream_count);
+    int sid = select_stream(job.subtitles, first.pg_streams, first.pg_stream_count);
+    if (aid < 0 || sid < 0) {
+        result.error = QString("no %1 stream %2").arg(aid < 0 ? "audio" : "subtitle", aid < 0 ? audio : job.subtitles);
+        return result;
+    }
+
+    QTemporaryFile chapter_file(QDir::tempPath() + "/mpv_bd_XXXXXX.ffmeta");
+    if (!chapter_file.open() || chapter_file.write(chapters(*title)) < 0 || !chapter_file.flush()) {
+        result.error = "cannot write chapters";
+        return result;
+    }
+
+    // mpv records next to the output, with the same container.
+    QFileInfo output(job.output);
+    QString recorded = output.path() + "/" + output.completeBaseName() + ".part." + output.suffix();
+
+    mpv_ptr mpv(mpv_create());
+    if (mpv == NULL) {
+        result.error = "cannot create mpv context";
+        return result;
+    }
+    // Demux as fast as the disc allows and record the packets; decoding is
+    // reduced to keyframes since no frame is shown. untimed only stops the
+    // wait between video frames: the null audio output still plays in real
+    // time and would pace everything, unless it is untimed as well.
+    mpv_set_option_string(mpv.get(), "vo", "null");
+    mpv_set_option_string(mpv.get(), "ao", "null");
+    mpv_set_option_string(mpv.get(), "ao-null-untimed", "yes");
+    mpv_set_option_string(mpv.get(), "untimed", "yes");
+    mpv_set_option_string(mpv.get(), "vd-lavc-skipframe", "nonkey");
+    mpv_set_option_string(mpv.get(), "rebase-start-time", "no");
+    mpv_set_option_string(mpv.get(), "stream-record", recorded.toUtf8().data());
+    mpv_set_option_string(mpv.get(), "aid", aid ? QByteArray::number(aid).data() : "no");
+    mpv_set_option_string(mpv.get(), "sid", sid ? QByteArray::number(sid).data() : "no");
+    mpv_request_log_messages(mpv.get(), "warn");
+    if (mpv_initialize(mpv.get()) < 0) {
+        result.error = "cannot initialize mpv context";
+        return result;
+    }
+    DiscIO::add_protocol(mpv.get());
+
+    QByteArray edl = timeline(*title, io.get());
+    const char *cmd[] = { "loadfile", edl.data(), NULL };
+    int error = mpv_command(mpv.get(), cmd);
+    while (error >= 0) {
+        mpv_event *event = mpv_wait_event(mpv.get(), -1);
+        if (event->event_id == MPV_EVENT_LOG_MESSAGE) {
+            mpv_event_log_message *msg = (mpv_event_log_message *)event->data;
+            char category[16];
+            snprintf(category, sizeof(category), "mpv/%s", msg->prefix);
+            Log::write((log_level_t)msg->log_level, category, "%s", msg->text);
+        } else if (event->event_id == MPV_EVENT_END_FILE) {
+            mpv_event_end_file *end = (mpv_event_end_file *)event->data;
+            if (end->reason == MPV_END_FILE_REASON_ERROR)
+                error = end->error;
+            else if (end->reason != MPV_END_FILE_REASON_EOF)
+                error = MPV_ERROR_GENERIC;
+            break;
+        } else if (event->event_id == MPV_EVENT_SHUTDOWN) {
+            error = MPV_ERROR_GENERIC;
+            break;
+        }
+    }
+    // The recording is finished when mpv is gone.
+    mpv.reset();
+    double record_seconds = timer.nsecsElapsed() / 1e9;
+
+    bool muxed = error >= 0 && mux_chapters(recorded, chapter_file.fileName(), job.output);
+    QFile::remove(recorded);
+    result.seconds = timer.nsecsElapsed() / 1e9;
+    if (!muxed) {
+        result.error = error < 0 ? QString(mpv_error_string(error)) : QString("cannot write %1").arg(job.output);
+        QFile::remove(job.output);
+        return result;
+    }
+    result.ok = true;
+    result.bytes = QFileInfo(job.output).size();
+    result.mb_per_s = result.seconds > 0 ? result.bytes / 1e6 / result.seconds : 0;
+    Log::write(LOG_LEVEL_INFO, "export", "%05u.mpls: %" PRIu64 " bytes in %.2f s (%.1f MB/s), "
+        "%.2f s recording, %.2f s adding chapters",
+        result.playlist, result.bytes, result.seconds, result.mb_per_s,
+        record_seconds, result.seconds - record_seconds);
+    return result;
+}
@@ -0,0 +1,64 @@
+#ifndef TITLEEXPORTER_H
+#define TITLEEXPORTER_H
+
+#include <vector>
+#include <cstdint>
+
+#include <QString>
+#include <QByteArray>
+
+#include <libbluray/bluray.h>
+
+class DiscIO;
+
+typedef struct {
+    // BDMV folder (or its parent) or ISO image.
+    QString disc;
+    QString output;
+    // Playlist to export, or the main feature if main_feature is set.
+    bool main_feature;
+    uint32_t playlist;
+    // ISO 639-2 language or 1-based stream number; empty picks the first
+    // audio stream and no subtitles.
+    QString audio;
+    QString subtitles;
+} export_job_t;
+
+typedef struct {
+    bool ok;
+    QString error;
+    uint32_t playlist;
+    uint32_t clips;
+    uint32_t chapters;
+    uint64_t duration; // 90 kHz
+    // Size of the written file.
+    uint64_t bytes;
+    double seconds;
+    double mb_per_s;
+} export_result_t;
+
+// Remuxes titles into single files without a GUI. The playlist's play items
+// are resolved through libbluray and handed to a headless mpv instance as
+// one EDL timeline of their in/out ranges, which mpv demuxes in order and
+// records packet by packet (stream-record), so nothing is re-encoded. The
+// recording, with the chosen audio and PG streams, is then remuxed with
+// libavformat to add the title's chapter marks. Jobs run in parallel on a
+// bounded thread pool, each with its own BLURAY, DiscIO and mpv instance.
+class TitleExporter {
+public:
+    explicit TitleExporter(int workers = 0);
+
+    // Results in the order of jobs.
+    std::vector<export_result_t> run(const std::vector<export_job_t> &jobs) const;
+    static export_result_t export_title(const export_job_t &job);
+
+private:
+    static int select_stream(const QString &wanted, const BLURAY_STREAM_INFO *streams, uint8_t count);
+    static QByteArray timeline(const BLURAY_TITLE_INFO &title, const DiscIO *io);
+    static QByteArray chapters(const BLURAY_TITLE_INFO &title);
+    static bool mux_chapters(const QString &recorded, const QString &chapters, const QString &output);
+
+    int workers;
+};
+
+#endif // TITLEEXPORTER_H